@@ -21,6 +21,15 @@
 #include <fstream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 #include <yarp/os/Network.h>
 #include <yarp/os/RFModule.h>
@@ -28,14 +37,178 @@
 #include <yarp/os/BufferedPort.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Vocab.h>
+#include <yarp/os/Mutex.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Stamp.h>
 #include <yarp/math/Math.h>
 #include <yarp/conf/system.h>
 
+#include "shmChannel.h"
+#include "rtConfig.h"
+
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
 using namespace yarp::math;
 
+/************************************************************************/
+// y = clamp(x*scale + offset, 0, 1) over n contiguous elements, without branches
+void scaleAndClamp(const double* x, const double* scale, const double* offset, double* y, int n)
+{
+    int i = 0;
+#if defined(__AVX__)
+    const __m256d zero4 = _mm256_setzero_pd();
+    const __m256d one4 = _mm256_set1_pd(1.0);
+    for ( ; i + 4 <= n ; i += 4)
+    {
+        __m256d v = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(scale + i)),
+                                  _mm256_loadu_pd(offset + i));
+        _mm256_storeu_pd(y + i, _mm256_min_pd(_mm256_max_pd(v, zero4), one4));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128d zero2 = _mm_setzero_pd();
+    const __m128d one2 = _mm_set1_pd(1.0);
+    for ( ; i + 2 <= n ; i += 2)
+    {
+        __m128d v = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(scale + i)), _mm_loadu_pd(offset + i));
+        _mm_storeu_pd(y + i, _mm_min_pd(_mm_max_pd(v, zero2), one2));
+    }
+#endif
+    for ( ; i < n ; ++i)
+    {
+        double v = x[i] * scale[i] + offset[i];
+        v = (v > 0.0) ? v : 0.0;
+        y[i] = (v < 1.0) ? v : 1.0;
+    }
+}
+
+/************************************************************************/
+// Normalization limits, stored as the affine transform x*scale + offset which maps the features to [0,1].
+//   fixed:   computed once from the configured limits
+// The online estimates are updated in O(d) per sample:
+//   running: Welford running mean and variance, [ mean - nSigma*std , mean + nSigma*std ] -> [0,1]
+//   decayed: exponentially decayed min/max. A sample outside [min, max] moves the limit to it,
+//            otherwise the limits contract towards the sample by the decay factor.
+class onlineLimits
+{
+private:
+    string              type;       // fixed, running or decayed
+    int                 d;
+    double              nSigma;     // Half width of the normalized interval in standard deviations
+    double              decay;      // Contraction factor of the decayed limits
+    double              minRange;   // Lower bound of the normalized interval width
+    long unsigned int   warmup;     // Samples before the estimates replace the current transform
+    long unsigned int   n;          // Number of samples
+    vector<double>      mean;       // Running mean
+    vector<double>      M2;         // Running sum of squared deviations
+    vector<double>      lo;         // Decayed min
+    vector<double>      hi;         // Decayed max
+    vector<double>      initLo;     // Initial limits (empty: none)
+    vector<double>      initHi;
+
+public:
+    vector<double>      scale;
+    vector<double>      offset;
+    
+    onlineLimits() : d(0), nSigma(3.0), decay(0.001), minRange(1e-6), warmup(2), n(0)
+    {
+    }
+    
+    // The initial limits, if not empty, are used until warmup samples have been received,
+    // and are the starting point of the decayed min/max
+    void configure(const string &_type, int _d, double _nSigma, double _decay, int _warmup,
+                   const vector<double> &initMin, const vector<double> &initMax)
+    {
+        type = _type;
+        d = _d;
+        nSigma = _nSigma;
+        decay = _decay;
+        warmup = (_warmup > 2) ? _warmup : 2;
+        initLo.clear();
+        initHi.clear();
+        if ((int)initMin.size() >= d && (int)initMax.size() >= d)
+        {
+            initLo.assign(initMin.begin(), initMin.begin() + d);
+            initHi.assign(initMax.begin(), initMax.begin() + d);
+        }
+        reset();
+    }
+    
+    // Forgets the samples and restores the initial limits
+    void reset()
+    {
+        mean.assign(d, 0.0);
+        M2.assign(d, 0.0);
+        lo.assign(d, 0.0);
+        hi.assign(d, 1.0);
+        scale.assign(d, 1.0);
+        offset.assign(d, 0.0);
+        n = 0;
+        
+        if (!initLo.empty())
+            for (int i = 0 ; i < d ; ++i)
+            {
+                lo[i] = initLo[i];
+                hi[i] = initHi[i];
+                setRange(i, lo[i], hi[i]);
+            }
+    }
+    
+    long unsigned int getCount() const { return n; }
+    
+    // Sets the transform mapping [a, b] to [0,1]
+    inline void setRange(int i, double a, double b)
+    {
+        double range = (b - a > minRange) ? b - a : minRange;
+        scale[i] = 1.0 / range;
+        offset[i] = -a * scale[i];
+    }
+    
+    void update(const double* x)
+    {
+        ++n;
+        if (type == "running")
+        {
+            for (int i = 0 ; i < d ; ++i)
+            {
+                double delta = x[i] - mean[i];
+                mean[i] += delta / n;
+                M2[i] += delta * (x[i] - mean[i]);
+            }
+            if (n < warmup)
+                return;
+            for (int i = 0 ; i < d ; ++i)
+            {
+                double sd = sqrt(M2[i] / (n - 1));
+                setRange(i, mean[i] - nSigma * sd, mean[i] + nSigma * sd);
+            }
+        }
+        else
+        {
+            for (int i = 0 ; i < d ; ++i)
+            {
+                if (n == 1 && initLo.empty())
+                    lo[i] = hi[i] = x[i];
+                
+                if (x[i] < lo[i])
+                    lo[i] = x[i];
+                else
+                    lo[i] += decay * (x[i] - lo[i]);
+                
+                if (x[i] > hi[i])
+                    hi[i] = x[i];
+                else
+                    hi[i] += decay * (x[i] - hi[i]);
+            }
+            if (n < warmup)
+                return;
+            for (int i = 0 ; i < d ; ++i)
+                setRange(i, lo[i], hi[i]);
+        }
+    }
+};
+
 /************************************************************************/
 class Normalizer: public RFModule
 {
@@ -44,6 +217,7 @@ protected:
     // Ports
     BufferedPort<Bottle>      outFeatures;
     BufferedPort<Bottle>      inFeatures;
+    BufferedPort<Bottle>      outStats;
     Port                      rpcPort;
     
     // Data
@@ -52,6 +226,75 @@ protected:
     Bottle maxes;      // Max limits
     Bottle mins;       // Min limits
     
+    // Online normalization
+    string normType;                // fixed, running or decayed
+    onlineLimits limits;            // Limits estimated from the data
+    Mutex limitsMutex;              // Protects limits and frozen from the rpc thread
+    int warmup;                     // Number of samples before the limits can be frozen
+    bool freeze;                    // Freeze the limits after the warm-up
+    bool frozen;                    // The limits are not updated anymore
+    int statsPeriod;                // The limits are published every statsPeriod samples (0: only when frozen)
+    vector<double> xin;             // Preallocated input features
+    vector<double> xout;            // Preallocated normalized features
+    
+    // Shared memory transport
+    bool useShmIn;                  // Read the input from the shared memory channel instead of features:i
+    shmChannel::reader shmIn;       // Channel created on the output port of the producer (shmFrom)
+    shmChannel::writer shmOut;      // Channel to a consumer on the same host, if it creates one
+    vector<double> shmBuf;          // Preallocated input message
+    vector<double> outBuf;          // Preallocated output message
+    Bottle shmBottle;               // Input read from the channel
+    double inStamp;                 // Time stamp of the current input
+    
+    /************************************************************************/
+    // Reads the next input, from features:i or from the shared memory channel
+    Bottle* readFeatures()
+    {
+        if (!useShmIn)
+        {
+            Bottle *b = inFeatures.read();    // blocking call
+            Stamp info;
+            inFeatures.getEnvelope(info);
+            inStamp = info.isValid() ? info.getTime() : Time::now();
+            return b;
+        }
+        
+        if (!shmIn.read(inStamp, shmBuf))
+            return 0;
+        shmBottle.clear();
+        for (size_t i = 0 ; i < shmBuf.size() ; ++i)
+            shmBottle.addDouble(shmBuf[i]);
+        return &shmBottle;
+    }
+    
+    /************************************************************************/
+    // Publishes the current limits in the format of the [LIMITS] group, plus (Frozen 0|1), to the
+    // stats:i port of RRLSestimator, which can wait for the frozen limits before learning and saves
+    // the limits its model was trained with as a configuration for a fixed run
+    void publishLimits()
+    {
+        Bottle& b = outStats.prepare();
+        b.clear();
+        addLimits(b);
+        Bottle &f = b.addList();
+        f.addString("Frozen");
+        f.addInt(frozen ? 1 : 0);
+        outStats.write();
+    }
+    
+    // Min and Max which reproduce the current transform x*scale + offset
+    void addLimits(Bottle &b)
+    {
+        Bottle &bmin = b.addList();
+        bmin.addString("Min");
+        for (int i = 0 ; i < d ; ++i)
+            bmin.addDouble(-limits.offset[i] / limits.scale[i]);
+        Bottle &bmax = b.addList();
+        bmax.addString("Max");
+        for (int i = 0 ; i < d ; ++i)
+            bmax.addDouble((1.0 - limits.offset[i]) / limits.scale[i]);
+    }
+    
 public:
     /************************************************************************/
     Normalizer()
@@ -73,8 +316,64 @@ public:
             reply.addVocab(Vocab::encode("many"));
             reply.addString("Available commands are:");
             reply.addString("help");
+            reply.addString("limits");
+            reply.addString("save <file>");
+            reply.addString("freeze");
+            reply.addString("unfreeze");
+            reply.addString("reset");
             reply.addString("quit");
         }
+        else if (normType != "fixed" && receivedCmd == "limits")
+        {
+            limitsMutex.lock();
+            addLimits(reply);
+            limitsMutex.unlock();
+        }
+        else if (normType != "fixed" && receivedCmd == "save")
+        {
+            // Writes the limits as a configuration file for the fixed normalization
+            string fileName = command.get(1).asString().c_str();
+            ofstream out(fileName.c_str());
+            if (!out.is_open())
+            {
+                reply.addString("Cannot open the file.");
+                return true;
+            }
+            limitsMutex.lock();
+            Bottle b;
+            addLimits(b);
+            limitsMutex.unlock();
+            out << "Type    fixed" << endl << "d       " << d << endl << endl << "[LIMITS]" << endl;
+            out << b.get(0).asList()->toString().c_str() << endl;
+            out << b.get(1).asList()->toString().c_str() << endl;
+            reply.addString("Limits saved.");
+        }
+        else if (normType != "fixed" && receivedCmd == "freeze")
+        {
+            limitsMutex.lock();
+            frozen = true;
+            publishLimits();
+            limitsMutex.unlock();
+            reply.addString("Limits frozen.");
+        }
+        else if (normType != "fixed" && receivedCmd == "unfreeze")
+        {
+            limitsMutex.lock();
+            frozen = false;
+            freeze = false;
+            publishLimits();
+            limitsMutex.unlock();
+            reply.addString("Limits unfrozen.");
+        }
+        else if (normType != "fixed" && receivedCmd == "reset")
+        {
+            limitsMutex.lock();
+            limits.reset();
+            frozen = false;
+            publishLimits();
+            limitsMutex.unlock();
+            reply.addString("Limits reset.");
+        }
         else if (receivedCmd == "quit")
         {
             reply.addString("Quitting.");
@@ -111,11 +410,51 @@ public:
             return false;
         }
         
+        // Normalization type
+        normType = rf.check("Type",Value("fixed")).asString().c_str();
+        if (normType != "fixed" && normType != "running" && normType != "decayed")
+        {
+            printf("Error: Unknown normalization type %s!\n", normType.c_str());
+            return false;
+        }
+        if (normType == "fixed" && maxes.size() < d)
+        {
+            printf("Error: Fixed normalization requires d limits!\n");
+            return false;
+        }
+        for (int i = 0 ; normType == "fixed" && i < d ; ++i)
+            if (maxes.get(i).asDouble() <= mins.get(i).asDouble())
+            {
+                printf("Error: Max must be greater than Min (element %d)!\n", i);
+                return false;
+            }
+        
+        // The fixed limits, if present, are the initial estimate of the online ones
+        vector<double> initMin, initMax;
+        for (int i = 0 ; i < mins.size() ; ++i)
+        {
+            initMin.push_back(mins.get(i).asDouble());
+            initMax.push_back(maxes.get(i).asDouble());
+        }
+        warmup = rf.check("warmup",Value(500)).asInt();
+        limits.configure(normType, d, rf.check("nSigma",Value(3.0)).asDouble(),
+                         rf.check("decay",Value(0.001)).asDouble(), warmup, initMin, initMax);
+        freeze = (rf.check("freeze",Value(0)).asInt() == 1);
+        frozen = false;
+        statsPeriod = rf.check("statsPeriod",Value(100)).asInt();
+        xin.assign(d, 0.0);
+        xout.assign(d, 0.0);
+        shmBuf.assign(d + t, 0.0);
+        outBuf.assign(d + t, 0.0);
+        
         // Print Configuration
         cout << endl << "-------------------------" << endl;
         cout << "Configuration parameters:" << endl << endl;
         cout << "d = " << d << endl;
         cout << "t = " << t << endl;
+        cout << "Type = " << normType << endl;
+        if (normType != "fixed")
+            cout << "warmup = " << warmup << (freeze ? ", then frozen" : "") << endl;
         printf("Limits:\n");
         for (int i=0; i<maxes.size(); i++) {
             printf("%d)  " , i);
@@ -124,18 +463,35 @@ public:
         }
         cout << "-------------------------" << endl << endl;
        
+        // Shared memory input, from the output port given by shmFrom
+        useShmIn = rf.check("shmFrom");
+        if (useShmIn && !shmIn.open(rf.find("shmFrom").asString().c_str(),
+                                    rf.check("shmSlots",Value(64)).asInt(), rf.check("shmMaxSize",Value(4096)).asInt()))
+            return false;
+
         // Open ports
         string fwslash="/";
         inFeatures.open((fwslash+name+"/features:i").c_str());
         printf("inFeatures opened\n");
         outFeatures.open((fwslash+name+"/features:o").c_str());
         printf("outFeatures opened\n");
+        shmOut.open(fwslash+name+"/features:o");
+        if (normType != "fixed")
+        {
+            outStats.open((fwslash+name+"/stats:o").c_str());
+            printf("outStats opened\n");
+        }
         rpcPort.open((fwslash+name+"/rpc:i").c_str());
         printf("rpcPort opened\n");
 
         // Attach rpcPort to the respond() method
         attach(rpcPort);
         
+        // Realtime options of the thread running updateModule
+        rtConfig::settings rt = rtConfig::read(rf);
+        rtConfig::configureProcess(rt);
+        rtConfig::configureThread(rt, 0, "normalization");
+        
         return true;
     }
 
@@ -147,6 +503,13 @@ public:
         printf("inFeatures port closed\n");
         outFeatures.close();
         printf("outFeatures port closed\n");
+        shmIn.close();
+        shmOut.close();
+        if (normType != "fixed")
+        {
+            outStats.close();
+            printf("outStats port closed\n");
+        }
         rpcPort.close();
         printf("rpcPort port closed\n");
 
@@ -170,29 +533,50 @@ public:
     {
 
         // Wait for input feature vector
-        Bottle *bin = inFeatures.read();    // blocking call
+        Bottle *bin = readFeatures();
 
         if (bin != 0)
         {
         Bottle& bout = outFeatures.prepare(); // Get a place to store things.
         bout.clear();  // clear is important - b might be a reused object
 
-            // Apply scaling of incoming features
-            for (int i = 0 ; i < d + t ; ++i)
+            for (int i = 0 ; i < d ; ++i)
+                xin[i] = bin->get(i).asDouble();
+            
+            limitsMutex.lock();
+            if (normType != "fixed" && !frozen)
             {
-
-                if (i<d)        // Add normalized features
+                limits.update(&xin[0]);
+                long unsigned int n = limits.getCount();
+                if (freeze && n >= (long unsigned int)warmup)
                 {
-                    if (bin->get(i).asDouble() < mins.get(i).asDouble())
-                        bout.add(0.0);
-                    else if (bin->get(i).asDouble() > maxes.get(i).asDouble())
-                        bout.add(1.0);
-                    else
-                        bout.add( ( bin->get(i).asDouble() - mins.get(i).asDouble() ) / (maxes.get(i).asDouble() - mins.get(i).asDouble() ) );
+                    frozen = true;
+                    printf("Limits frozen after %lu samples\n", n);
+                    publishLimits();
                 }
-                else            // Add labels
-                    bout.add(bin->get(i).asDouble());   
+                else if (statsPeriod > 0 && n % statsPeriod == 0)
+                    publishLimits();
+            }
+            
+            // Apply scaling of incoming features
+            scaleAndClamp(&xin[0], &limits.scale[0], &limits.offset[0], &xout[0], d);
+            limitsMutex.unlock();
+            
+            // Add normalized features
+            for (int i = 0 ; i < d ; ++i)
+            {
+                bout.addDouble(xout[i]);
+                outBuf[i] = xout[i];
+            }
+            
+            // Add labels
+            for (int i = d ; i < d + t ; ++i)
+            {
+                outBuf[i] = bin->get(i).asDouble();
+                bout.addDouble(outBuf[i]);
             }
+            
+            shmOut.write(inStamp, &outBuf[0], d + t);
             outFeatures.write();
         }
 
@@ -208,6 +592,12 @@ public:
         // Interrupt any blocking reads on the output port
         outFeatures.interrupt();
         printf("outFeatures port interrupted\n");
+        shmIn.interrupt();
+        if (normType != "fixed")
+        {
+            outStats.interrupt();
+            printf("outStats port interrupted\n");
+        }
 
         // Interrupt any blocking reads on the rpc port        
         rpcPort.interrupt();
@@ -218,9 +608,108 @@ public:
 };
 
 
+/************************************************************************/
+// Compares the per-sample cost of the Bottle-based scaling, with the limits looked up in
+// the Min/Max Bottles, and of the contiguous scale/offset arrays
+int runScalingBenchmark(ResourceFinder &rf)
+{
+    Bottle dList;
+    dList.fromString("12 100 1000");
+    if (rf.find("benchD").isList())
+        dList = *rf.find("benchD").asList();
+    else if (rf.check("benchD"))
+    {
+        dList.clear();
+        dList.addInt(rf.find("benchD").asInt());
+    }
+    int t = rf.check("t",Value(6)).asInt();
+    int benchN = rf.check("benchN",Value(100000)).asInt();
+    
+    printf("Normalization benchmark, %d samples per configuration, t = %d\n", benchN, t);
+    printf("%8s %18s %18s %18s\n", "d", "Bottle limits [ns]", "arrays [ns]", "kernel only [ns]");
+    for (int k = 0 ; k < dList.size() ; ++k)
+    {
+        int d = dList.get(k).asInt();
+        Bottle mins, maxes, bin, bout;
+        vector<double> scale(d), offset(d), xin(d), xout(d);
+        for (int i = 0 ; i < d ; ++i)
+        {
+            double lo = -100.0 * rand() / RAND_MAX;
+            double hi = 100.0 * rand() / RAND_MAX + 1.0;
+            mins.addDouble(lo);
+            maxes.addDouble(hi);
+            scale[i] = 1.0 / (hi - lo);
+            offset[i] = -lo * scale[i];
+        }
+        for (int i = 0 ; i < d + t ; ++i)
+            bin.addDouble(250.0 * rand() / RAND_MAX - 125.0);
+        
+        // Limits looked up in the Bottles, one division per element
+        double t0 = Time::now();
+        for (int n = 0 ; n < benchN ; ++n)
+        {
+            bout.clear();
+            for (int i = 0 ; i < d + t ; ++i)
+            {
+                if (i<d)
+                {
+                    if (bin.get(i).asDouble() < mins.get(i).asDouble())
+                        bout.add(0.0);
+                    else if (bin.get(i).asDouble() > maxes.get(i).asDouble())
+                        bout.add(1.0);
+                    else
+                        bout.add( ( bin.get(i).asDouble() - mins.get(i).asDouble() ) / (maxes.get(i).asDouble() - mins.get(i).asDouble() ) );
+                }
+                else
+                    bout.add(bin.get(i).asDouble());
+            }
+        }
+        double tBottle = (Time::now() - t0) / benchN;
+        
+        // Contiguous arrays, including the Bottle input/output
+        t0 = Time::now();
+        for (int n = 0 ; n < benchN ; ++n)
+        {
+            bout.clear();
+            for (int i = 0 ; i < d ; ++i)
+                xin[i] = bin.get(i).asDouble();
+            scaleAndClamp(&xin[0], &scale[0], &offset[0], &xout[0], d);
+            for (int i = 0 ; i < d ; ++i)
+                bout.addDouble(xout[i]);
+            for (int i = d ; i < d + t ; ++i)
+                bout.add(bin.get(i).asDouble());
+        }
+        double tArrays = (Time::now() - t0) / benchN;
+        
+        // Transform only
+        double check = 0.0;
+        t0 = Time::now();
+        for (int n = 0 ; n < benchN ; ++n)
+        {
+            xin[n % d] += 1e-9;
+            scaleAndClamp(&xin[0], &scale[0], &offset[0], &xout[0], d);
+            check += xout[n % d];
+        }
+        double tKernel = (Time::now() - t0) / benchN;
+        
+        printf("%8d %18.1f %18.1f %18.1f\n", d, 1e9 * tBottle, 1e9 * tArrays, 1e9 * tKernel);
+        if (check < 0.0)
+            printf("Error: negative normalized feature\n");
+    }
+    return 0;
+}
+
 /************************************************************************/
 int main(int argc, char *argv[])
 {
+    // The benchmark does not need the YARP network
+    {
+        ResourceFinder rf;
+        rf.configure(argc,argv);
+        if (rf.check("benchmark"))
+            return runScalingBenchmark(rf);
+    }
+    
     Network yarp;
     if (!yarp.checkNetwork())
     {
@@ -28,7 +28,14 @@ Author: Raffaello Camoriano
 CopyPolicy: Released under the terms of the GNU GPL v2.0. 
 
 \section intro_sec Description 
-A module that reads the projections from the configuration file RFmapper.ini and applies them to the incoming normalized samples
+A module that reads the projections from the configuration file RFmapper.ini and applies them to the incoming normalized samples.
+
+Two mappings are available (general::mappingType):
+- 1: random Fourier features [ sin(Wx) cos(Wx) ], 2*numRF features;
+- 2: Nystrom features of the Gaussian kernel of width general::sigma on general::numLandmarks landmarks,
+  drawn from the first d columns of general::landmarkFile, numLandmarks features.
+
+In both cases the output is the features followed by the t labels.
 
 \author Raffaello Camoriano
 */ 
@@ -50,6 +57,8 @@ A module that reads the projections from the configuration file RFmapper.ini and
 #include <yarp/os/Bottle.h>
 #include <yarp/os/BufferedPort.h>
 #include <yarp/os/Vocab.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Stamp.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/sig/Matrix.h>
 #include <yarp/math/Math.h>
@@ -57,6 +66,10 @@ A module that reads the projections from the configuration file RFmapper.ini and
 #include <yarp/conf/system.h>
 //#include <iCub/perception/models.h>
 
+#include "shmChannel.h"
+#include "rtConfig.h"
+#include "nystromMapper.h"
+
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
@@ -117,6 +130,37 @@ void load_matrix(std::istream* is,
 
 
 
+/************************************************************************/
+// Loads the rows of an ascii file with at least width elements per line, separated by delim characters.
+// Returns the number of rows.
+long unsigned int load_rows(std::istream* is, int width, vector<double> &rows, const std::string& delim = " \t,")
+{
+    string line;
+    long unsigned int n = 0;
+    rows.clear();
+    while (getline(*is, line))
+    {
+        for (string::iterator i = line.begin(); i != line.end(); i++)
+            if (delim.find(*i) != string::npos)
+                *i = ' ';
+        istringstream ss(line);
+        double number;
+        int colidx = 0;
+        while (colidx < width && ss >> number)
+        {
+            rows.push_back(number);
+            ++colidx;
+        }
+        if (colidx < width)
+        {
+            rows.resize(n * width);     // Empty or short line
+            continue;
+        }
+        ++n;
+    }
+    return n;
+}
+
 /************************************************************************/
 class RFmapper: public RFModule
 {
@@ -134,9 +178,127 @@ protected:
     string projFName;   // File name of the projections matrix
     Matrix projMat;    // Pointer to the [numRF x d]-dimensional list of projections
     int mappingType;
+    int numOut;         // Number of output features
+    nystromMapper nystrom;
     Vector xin;
     Bottle vout;
     
+    // Shared memory transport
+    bool useShmIn;                  // Read the input from the shared memory channel instead of features:i
+    shmChannel::reader shmIn;       // Channel created on the output port of the producer (shmFrom)
+    shmChannel::writer shmOut;      // Channel to a consumer on the same host, if it creates one
+    vector<double> shmBuf;          // Preallocated input message
+    vector<double> outBuf;          // Preallocated output message
+    Bottle shmBottle;               // Input read from the channel
+    double inStamp;                 // Time stamp of the current input
+    
+    /************************************************************************/
+    // Reads the next input, from features:i or from the shared memory channel
+    Bottle* readFeatures()
+    {
+        if (!useShmIn)
+        {
+            Bottle *b = inFeatures.read();    // blocking call
+            Stamp info;
+            inFeatures.getEnvelope(info);
+            inStamp = info.isValid() ? info.getTime() : Time::now();
+            return b;
+        }
+        
+        if (!shmIn.read(inStamp, shmBuf))
+            return 0;
+        shmBottle.clear();
+        for (size_t i = 0 ; i < shmBuf.size() ; ++i)
+            shmBottle.addDouble(shmBuf[i]);
+        return &shmBottle;
+    }
+    
+    /************************************************************************/
+    // Random Fourier features: loads the [numRF x d] projections matrix
+    bool loadProjections(ResourceFinder &rf)
+    {
+        numRF = rf.findGroup("general").check("numRF",Value(0)).asInt();
+            
+        if (d <= 0 || t <= 0 || numRF <= 0)
+        {
+            printf("Error: Inconsistent dimensionalities!\n");
+            return false;
+        }
+
+        projMat.resize(numRF,d);      // Initialize projections matrix
+        
+        // Load precomputed projections from the specified file
+        string projFName = rf.findGroup("general").find("proj").toString();
+        if (projFName=="")
+        {
+            cout<<"Sorry no projections were found, check config parameters"<<endl;
+            return false;
+        }
+        projFName = rf.getContextPath() + "/proj/" + projFName;
+        cout << "Using projections file: " << projFName.c_str() << endl;
+
+        ifstream* ifs = new ifstream;   //WARNING: Deallocate!
+
+        cout << "Trying to open ifstream..." << endl;        
+        ifs->open(projFName.c_str(), std::ifstream::in);
+        cout << "ifstream opened..." << endl;
+        load_matrix(ifs, projMat, " ");
+        cout << "Projections matrix loaded. Size: " << projMat.rows() << " x " << projMat.cols() << endl;
+        
+        if (projMat.rows() != numRF || projMat.cols() != d )
+        {
+            printf("Error: Inconsistent dimensionalities!\n");
+            return false;
+        }
+        
+        return true;
+    }
+
+    /************************************************************************/
+    // Nystrom features: draws the landmarks from the inputs of a pretraining file and
+    // precomputes the whitening matrix
+    bool loadLandmarks(ResourceFinder &rf)
+    {
+        Bottle &general = rf.findGroup("general");
+        int numLandmarks = general.check("numLandmarks",Value(0)).asInt();
+        double sigma = general.check("sigma",Value(1.0)).asDouble();
+        int landmarkSeed = general.check("landmarkSeed",Value(1)).asInt();
+        string landmarkFName = general.check("landmarkFile",Value("")).asString().c_str();
+        
+        if (d <= 0 || t <= 0 || numLandmarks <= 0 || sigma <= 0.0)
+        {
+            printf("Error: Inconsistent dimensionalities!\n");
+            return false;
+        }
+        if (landmarkFName == "")
+        {
+            cout << "Sorry no landmark file was found, check config parameters" << endl;
+            return false;
+        }
+        landmarkFName = rf.getContextPath() + "/data/" + landmarkFName;
+        cout << "Drawing " << numLandmarks << " landmarks from: " << landmarkFName.c_str() << endl;
+        
+        ifstream ifs(landmarkFName.c_str(), std::ifstream::in);
+        if (!ifs.is_open())
+        {
+            printf("Error: cannot open %s\n", landmarkFName.c_str());
+            return false;
+        }
+        vector<double> samples;
+        long unsigned int n = load_rows(&ifs, d, samples);
+        
+        vector<double> landmarks;
+        if (!nystromMapper::selectLandmarks(samples, n, d, d, numLandmarks, landmarkSeed, landmarks))
+            return false;
+        
+        double t0 = Time::now();
+        if (!nystrom.configure(&landmarks[0], numLandmarks, d, sigma))
+            return false;
+        printf("Nystrom whitening matrix computed in %.2f s (rank %d)\n", Time::now() - t0, nystrom.getRank());
+        
+        return true;
+    }
+    
 public:
     /************************************************************************/
     RFmapper()
@@ -179,44 +341,36 @@ public:
         // Set dimensionalities
         d = rf.findGroup("general").check("d",Value(0)).asInt();
         t = rf.findGroup("general").check("t",Value(0)).asInt();
-        numRF = rf.findGroup("general").check("numRF",Value(0)).asInt();
-            
-        if (d <= 0 || t <= 0 || numRF <= 0)
+        
+        // Set mapping type
+        mappingType = rf.findGroup("general").check("mappingType",Value(1)).asInt();
+        
+        if (mappingType == 1)
         {
-            printf("Error: Inconsistent dimensionalities!\n");
-            return false;
+            if (!loadProjections(rf))
+                return false;
+            numOut = 2*numRF;
         }
-
-        projMat.resize(numRF,d);      // Initialize projections matrix
-        
-        // Load precomputed projections from the specified file
-        string projFName = rf.findGroup("general").find("proj").toString();
-        if (projFName=="")
+        else if (mappingType == 2)
         {
-            cout<<"Sorry no projections were found, check config parameters"<<endl;
-            return -1;
+            if (!loadLandmarks(rf))
+                return false;
+            numOut = nystrom.getSize();
         }
-        projFName = rf.getContextPath() + "/proj/" + projFName;
-        cout << "Using projections file: " << projFName.c_str() << endl;
-
-        ifstream* ifs = new ifstream;   //WARNING: Deallocate!
-
-        cout << "Trying to open ifstream..." << endl;        
-        ifs->open(projFName.c_str(), std::ifstream::in);
-        cout << "ifstream opened..." << endl;
-        load_matrix(ifs, projMat, " ");
-        cout << "Projections matrix loaded. Size: " << projMat.rows() << " x " << projMat.cols() << endl;
-        
-        if (projMat.rows() != numRF || projMat.cols() != d )
+        else
         {
-            printf("Error: Inconsistent dimensionalities!\n");
+            printf("Error: Mapping type not available!\n");
             return false;
         }
-        
-        // Set mapping type
-        mappingType = rf.findGroup("general").check("mappingType",Value(1)).asInt();
     
         xin.resize(d);
+        outBuf.assign(numOut + t, 0.0);
+
+        // Shared memory input, from the output port given by shmFrom
+        useShmIn = rf.check("shmFrom");
+        if (useShmIn && !shmIn.open(rf.find("shmFrom").asString().c_str(),
+                                    rf.check("shmSlots",Value(64)).asInt(), rf.check("shmMaxSize",Value(4096)).asInt()))
+            return false;
 
         // Open ports
         string fwslash="/";
@@ -224,12 +378,18 @@ public:
         printf("inFeatures opened\n");
         outFeatures.open((fwslash+name+"/features:o").c_str());
         printf("outFeatures opened\n");
+        shmOut.open(fwslash+name+"/features:o");
         rpcPort.open((fwslash+name+"/rpc:i").c_str());
         printf("rpcPort opened\n");
 
         // Attach rpcPort to the respond() method
         attach(rpcPort);
         
+        // Realtime options of the thread running updateModule
+        rtConfig::settings rt = rtConfig::read(rf);
+        rtConfig::configureProcess(rt);
+        rtConfig::configureThread(rt, 0, "mapping");
+        
         return true;
     }
 
@@ -241,6 +401,8 @@ public:
         printf("inFeatures port closed\n");
         outFeatures.close();
         printf("outFeatures port closed\n");
+        shmIn.close();
+        shmOut.close();
         rpcPort.close();
         printf("rpcPort port closed\n");
 
@@ -264,7 +426,7 @@ public:
     {
         
         // Wait for incoming sample
-        Bottle *vin = inFeatures.read();    // blocking call
+        Bottle *vin = readFeatures();
         
         if (vin == 0)
         {
@@ -307,18 +469,34 @@ public:
                 if (i < 2*numRF)      // Add mapped features
                 {
                     if(i < numRF)
-                        xout.addDouble(sinwx[i]);
+                        outBuf[i] = sinwx[i];
                     else
-                        xout.addDouble(coswx[i-numRF]);
+                        outBuf[i] = coswx[i-numRF];
                 }
                 else                  // Add labels
-                    xout.add(vin->get( i - 2*numRF + d ).asDouble());
+                    outBuf[i] = vin->get( i - 2*numRF + d ).asDouble();
+                xout.addDouble(outBuf[i]);
             }
             outFeatures.write();
+            shmOut.write(inStamp, &outBuf[0], 2*numRF + t);
             
             // Debug
             cout << "Mapping sent:" << endl << xout.toString() << endl;
         }
+        else if (mappingType == 2)
+        {
+            nystrom.map(&xin[0], &outBuf[0]);
+            for (int i = 0 ; i < t ; ++i)
+                outBuf[numOut + i] = vin->get(d + i).asDouble();      // Add labels
+            
+            // Send output features
+            Bottle &xout = outFeatures.prepare();
+            xout.clear(); //important, objects get recycled
+            for (int i = 0 ; i < numOut + t ; ++i)
+                xout.addDouble(outBuf[i]);
+            outFeatures.write();
+            shmOut.write(inStamp, &outBuf[0], numOut + t);
+        }
         else
         {
             printf("Error: Mapping type not available!\n");
@@ -336,6 +514,7 @@ public:
         // Interrupt any blocking reads on the output port
         outFeatures.interrupt();
         printf("outFeatures port interrupted\n");
+        shmIn.interrupt();
 
         // Interrupt any blocking reads on the rpc port        
         rpcPort.interrupt();
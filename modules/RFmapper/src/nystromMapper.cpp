@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include "nystromMapper.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// exp(x) = 2^n exp(r), with n = round(x / ln2) and r = x - n ln2 in [-ln2/2, ln2/2].
+// ln2 is split in a high part exact in a few bits and a low part, so that n ln2 is subtracted without
+// cancellation, and exp(r) is the Taylor polynomial of degree 12 (truncation error < 2e-17).
+static const double EXP_MIN = -708.0;
+static const double LOG2E = 1.4426950408889634;
+static const double LN2_HI = 6.93145751953125e-1;
+static const double LN2_LO = 1.42860682030941723212e-6;
+static const double EXP_C[13] = { 1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320,
+                                  1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600 };
+
+/*************************************************************************************************/
+void expNonPositive(const double *x, double *y, int n)
+{
+    int i = 0;
+#if defined(__AVX__)
+    {
+        const __m256d xmin = _mm256_set1_pd(EXP_MIN);
+        const __m256d log2e = _mm256_set1_pd(LOG2E);
+        const __m256d ln2hi = _mm256_set1_pd(LN2_HI);
+        const __m256d ln2lo = _mm256_set1_pd(LN2_LO);
+        const __m128i bias = _mm_set1_epi32(1023);
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; i + 4 <= n ; i += 4)
+        {
+            __m256d v = _mm256_max_pd(_mm256_loadu_pd(x + i), xmin);
+            __m128i ni = _mm256_cvtpd_epi32(_mm256_mul_pd(v, log2e));      // rounds to nearest
+            __m256d nd = _mm256_cvtepi32_pd(ni);
+            __m256d r = _mm256_sub_pd(_mm256_sub_pd(v, _mm256_mul_pd(nd, ln2hi)), _mm256_mul_pd(nd, ln2lo));
+            __m256d p = _mm256_set1_pd(EXP_C[12]);
+            for (int c = 11 ; c >= 0 ; --c)
+                p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(EXP_C[c]));
+            // 2^n from the biased exponent; AVX has no 256 bit integer operations, so two SSE2 halves are built
+            __m128i e = _mm_add_epi32(ni, bias);
+            __m128i lo = _mm_slli_epi64(_mm_unpacklo_epi32(e, zero), 52);
+            __m128i hi = _mm_slli_epi64(_mm_unpackhi_epi32(e, zero), 52);
+            __m256d scale = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_castsi128_pd(lo)), _mm_castsi128_pd(hi), 1);
+            _mm256_storeu_pd(y + i, _mm256_mul_pd(p, scale));
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128d xmin = _mm_set1_pd(EXP_MIN);
+        const __m128d log2e = _mm_set1_pd(LOG2E);
+        const __m128d ln2hi = _mm_set1_pd(LN2_HI);
+        const __m128d ln2lo = _mm_set1_pd(LN2_LO);
+        const __m128i bias = _mm_set1_epi32(1023);
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; i + 2 <= n ; i += 2)
+        {
+            __m128d v = _mm_max_pd(_mm_loadu_pd(x + i), xmin);
+            __m128i ni = _mm_cvtpd_epi32(_mm_mul_pd(v, log2e));            // rounds to nearest
+            __m128d nd = _mm_cvtepi32_pd(ni);
+            __m128d r = _mm_sub_pd(_mm_sub_pd(v, _mm_mul_pd(nd, ln2hi)), _mm_mul_pd(nd, ln2lo));
+            __m128d p = _mm_set1_pd(EXP_C[12]);
+            for (int c = 11 ; c >= 0 ; --c)
+                p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(EXP_C[c]));
+            __m128i e = _mm_slli_epi64(_mm_unpacklo_epi32(_mm_add_epi32(ni, bias), zero), 52);
+            _mm_storeu_pd(y + i, _mm_mul_pd(p, _mm_castsi128_pd(e)));
+        }
+    }
+#endif
+    for ( ; i < n ; ++i)
+        y[i] = exp(x[i] > EXP_MIN ? x[i] : EXP_MIN);
+}
+
+/*************************************************************************************************/
+// Cyclic Jacobi eigendecomposition of the symmetric m x m matrix A (destroyed): on return the diagonal
+// of A holds the eigenvalues and the columns of V the eigenvectors.
+static void jacobiEigen(vector<double> &A, vector<double> &V, int m)
+{
+    V.assign(m*m, 0.0);
+    for (int i = 0 ; i < m ; ++i)
+        V[i*m + i] = 1.0;
+
+    double total = 0.0;
+    for (int i = 0 ; i < m*m ; ++i)
+        total += A[i]*A[i];
+
+    for (int sweep = 0 ; sweep < 50 ; ++sweep)
+    {
+        double off = 0.0;
+        for (int p = 0 ; p < m ; ++p)
+            for (int q = p+1 ; q < m ; ++q)
+                off += A[p*m + q]*A[p*m + q];
+        if (off <= 1e-30 * total)
+            break;
+
+        for (int p = 0 ; p < m ; ++p)
+            for (int q = p+1 ; q < m ; ++q)
+            {
+                const double apq = A[p*m + q];
+                if (fabs(apq) < 1e-300)
+                    continue;
+                // Rotation which annihilates A(p,q)
+                const double theta = (A[q*m + q] - A[p*m + p]) / (2.0 * apq);
+                const double tn = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+                const double c = 1.0 / sqrt(tn*tn + 1.0);
+                const double s = tn * c;
+                for (int k = 0 ; k < m ; ++k)
+                {
+                    const double akp = A[k*m + p];
+                    const double akq = A[k*m + q];
+                    A[k*m + p] = c*akp - s*akq;
+                    A[k*m + q] = s*akp + c*akq;
+                }
+                double *Ap = &A[p*m];
+                double *Aq = &A[q*m];
+                for (int k = 0 ; k < m ; ++k)
+                {
+                    const double apk = Ap[k];
+                    const double aqk = Aq[k];
+                    Ap[k] = c*apk - s*aqk;
+                    Aq[k] = s*apk + c*aqk;
+                }
+                for (int k = 0 ; k < m ; ++k)
+                {
+                    const double vkp = V[k*m + p];
+                    const double vkq = V[k*m + q];
+                    V[k*m + p] = c*vkp - s*vkq;
+                    V[k*m + q] = s*vkp + c*vkq;
+                }
+            }
+    }
+}
+
+/*************************************************************************************************/
+nystromMapper::nystromMapper() : m(0), d(0), gamma(0.0), rank(0)
+{
+}
+
+/*************************************************************************************************/
+bool nystromMapper::configure(const double *landmarks, int nLandmarks, int nInputs, double sigma, double eigTol)
+{
+    if (nLandmarks <= 0 || nInputs <= 0 || sigma <= 0.0)
+    {
+        printf("Error: Inconsistent Nystrom parameters!\n");
+        return false;
+    }
+    m = nLandmarks;
+    d = nInputs;
+    gamma = 1.0 / (2.0 * sigma * sigma);
+
+    L.assign(landmarks, landmarks + m*d);
+    Lnorm.assign(m, 0.0);
+    for (int j = 0 ; j < m ; ++j)
+        for (int i = 0 ; i < d ; ++i)
+            Lnorm[j] += L[j*d + i] * L[j*d + i];
+    kx.assign(m, 0.0);
+
+    // K_mm
+    vector<double> K(m*m);
+    for (int j = 0 ; j < m ; ++j)
+    {
+        K[j*m + j] = 1.0;
+        for (int q = j+1 ; q < m ; ++q)
+        {
+            double dist = 0.0;
+            for (int i = 0 ; i < d ; ++i)
+            {
+                const double diff = L[j*d + i] - L[q*d + i];
+                dist += diff * diff;
+            }
+            K[j*m + q] = K[q*m + j] = exp(-gamma * dist);
+        }
+    }
+
+    // K_mm^-1/2 = V diag(lambda^-1/2) V^T, dropping the negligible eigenvalues
+    vector<double> V;
+    jacobiEigen(K, V, m);
+    double maxEig = 0.0;
+    for (int j = 0 ; j < m ; ++j)
+        if (K[j*m + j] > maxEig)
+            maxEig = K[j*m + j];
+    vector<double> invSqrt(m, 0.0);
+    rank = 0;
+    for (int j = 0 ; j < m ; ++j)
+        if (K[j*m + j] > eigTol * maxEig)
+        {
+            invSqrt[j] = 1.0 / sqrt(K[j*m + j]);
+            ++rank;
+        }
+
+    Wh.assign(m*m, 0.0);
+    for (int a = 0 ; a < m ; ++a)
+        for (int b = a ; b < m ; ++b)
+        {
+            double acc = 0.0;
+            for (int j = 0 ; j < m ; ++j)
+                acc += V[a*m + j] * invSqrt[j] * V[b*m + j];
+            Wh[a*m + b] = Wh[b*m + a] = acc;
+        }
+
+    if (rank < m)
+        printf("Warning: K_mm has rank %d < %d landmarks => the Nystrom features span a %d-dimensional space\n", rank, m, rank);
+    return true;
+}
+
+/*************************************************************************************************/
+bool nystromMapper::selectLandmarks(const vector<double> &samples, long unsigned int n, int width, int nInputs,
+                                    int nLandmarks, unsigned int seed, vector<double> &landmarks)
+{
+    if (nLandmarks <= 0 || (long unsigned int)nLandmarks > n || width < nInputs)
+    {
+        printf("Error: %d landmarks cannot be selected from %lu samples!\n", nLandmarks, n);
+        return false;
+    }
+
+    // Partial Fisher-Yates shuffle of the row indices
+    vector<long unsigned int> rows(n);
+    for (long unsigned int j = 0 ; j < n ; ++j)
+        rows[j] = j;
+    mt19937 rng(seed);
+    landmarks.resize(nLandmarks * nInputs);
+    for (int j = 0 ; j < nLandmarks ; ++j)
+    {
+        uniform_int_distribution<long unsigned int> pick(j, n - 1);
+        long unsigned int k = pick(rng);
+        long unsigned int tmp = rows[j];
+        rows[j] = rows[k];
+        rows[k] = tmp;
+        for (int i = 0 ; i < nInputs ; ++i)
+            landmarks[j*nInputs + i] = samples[rows[j]*width + i];
+    }
+    return true;
+}
+
+/*************************************************************************************************/
+void nystromMapper::map(const double *x, double *phi)
+{
+    double xnorm = 0.0;
+    for (int i = 0 ; i < d ; ++i)
+        xnorm += x[i] * x[i];
+
+    // Exponents -gamma ||x - l_j||^2, clamped at 0 against the rounding of the expanded distance
+    for (int j = 0 ; j < m ; ++j)
+    {
+        const double *Lj = &L[j*d];
+        double dot = 0.0;
+        for (int i = 0 ; i < d ; ++i)
+            dot += Lj[i] * x[i];
+        const double arg = -gamma * (xnorm + Lnorm[j] - 2.0 * dot);
+        kx[j] = (arg < 0.0) ? arg : 0.0;
+    }
+    expNonPositive(&kx[0], &kx[0], m);
+
+    // phi = K_mm^-1/2 k(x)
+    for (int a = 0 ; a < m ; ++a)
+    {
+        const double *Wa = &Wh[a*m];
+        double acc = 0.0;
+        for (int j = 0 ; j < m ; ++j)
+            acc += Wa[j] * kx[j];
+        phi[a] = acc;
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _NYSTROM_MAPPER
+#define _NYSTROM_MAPPER
+
+#include <vector>
+
+/** Nyström feature map of the Gaussian kernel
+ * \f$ k(x, x') = \exp(-\|x - x'\|^2 / (2 \sigma^2)) \f$ on m landmarks \f$ l_1 \dots l_m \f$:
+ * \f[
+ * \phi(x) = K_{mm}^{-1/2} \, [k(x, l_1) \dots k(x, l_m)]^T,
+ * \f]
+ * so that \f$ \phi(x)^T \phi(x') \f$ is the Nyström approximation of \f$ k(x, x') \f$.
+ *
+ * The whitening matrix \f$ K_{mm}^{-1/2} \f$ is computed once by configure() with a Jacobi
+ * eigendecomposition; the eigenvalues below eigTol times the largest one are dropped (pseudo-inverse),
+ * which makes duplicate or nearly collinear landmarks harmless.
+ *
+ * A mapping costs \f$ O(md + m^2) \f$: the distances to the landmarks are computed as
+ * \f$ \|x\|^2 + \|l_j\|^2 - 2 l_j^T x \f$ with precomputed landmark norms, and the kernel values are
+ * evaluated with a vectorized exp. No memory is allocated by map().
+ */
+class nystromMapper
+{
+private:
+    int                     m;          // Number of landmarks
+    int                     d;          // Input size
+    double                  gamma;      // 1 / (2 sigma^2)
+    int                     rank;       // Eigenvalues kept in the whitening matrix
+    std::vector<double>     L;          // Landmarks (m x d)
+    std::vector<double>     Lnorm;      // Squared norms of the landmarks
+    std::vector<double>     Wh;         // Whitening matrix K_mm^-1/2 (m x m)
+    std::vector<double>     kx;         // Workspace: kernel values of the current input
+
+public:
+    nystromMapper();
+
+    /** Sets the landmarks and computes the whitening matrix.
+     * @param landmarks Row-major m x d matrix of landmarks.
+     * @param nLandmarks The number of landmarks m.
+     * @param nInputs The input size d.
+     * @param sigma The width of the Gaussian kernel.
+     * @param eigTol Eigenvalues of K_mm below eigTol times the largest one are discarded.
+     * @return False if the parameters are inconsistent. */
+    bool configure(const double *landmarks, int nLandmarks, int nInputs, double sigma, double eigTol = 1e-10);
+
+    /** Selects m distinct landmarks uniformly at random among the first d columns of the rows of a sample matrix.
+     * @param samples Row-major n x width matrix.
+     * @param n The number of rows.
+     * @param width The number of columns (at least d).
+     * @param nInputs The input size d.
+     * @param nLandmarks The number of landmarks m (at most n).
+     * @param seed Seed of the random selection.
+     * @param landmarks Filled with the row-major m x d matrix of landmarks.
+     * @return False if there are not enough rows. */
+    static bool selectLandmarks(const std::vector<double> &samples, long unsigned int n, int width, int nInputs,
+                                int nLandmarks, unsigned int seed, std::vector<double> &landmarks);
+
+    /** Maps an input.
+     * @param x Input vector (size d).
+     * @param phi Filled with the features (size m). */
+    void map(const double *x, double *phi);
+
+    /** @return The number of features m. */
+    inline int getSize() const { return m; }
+
+    /** @return The rank of the whitening matrix. */
+    inline int getRank() const { return rank; }
+};
+
+/** Vectorized \f$ y_i = \exp(x_i) \f$ for \f$ x_i \le 0 \f$, as needed by the Gaussian kernel. Arguments below
+ * -708 return \f$ e^{-708} \f$. The relative error is below 1e-15. */
+void expNonPositive(const double *x, double *y, int n);
+
+#endif
@@ -22,20 +22,36 @@
 #include <sstream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
 #include <yarp/os/Time.h>
 
-#include "gurls++/recrlswrapperchol.h"
-#include "gurls++/rlsprimal.h"
-#include "gurls++/primal.h"
+#include "gurls++/gmat2d.h"
+#include "gurls++/exceptions.h"
+
+#include "recursiveRLSCholesky.h"
+#include "outlierGate.h"
+#include "perfMetrics.h"
+#include "errorLogger.h"
 
 #include <yarp/os/Network.h>
 #include <yarp/os/RFModule.h>
 #include <yarp/os/Bottle.h>
 #include <yarp/os/BufferedPort.h>
 #include <yarp/os/Vocab.h>
+#include <yarp/os/Thread.h>
+#include <yarp/os/Mutex.h>
+#include <yarp/os/Semaphore.h>
 #include <yarp/math/Math.h>
 #include <yarp/conf/system.h>
 
+#include "shmChannel.h"
+#include "rtConfig.h"
+
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
@@ -44,6 +60,525 @@ using namespace gurls;
 
 typedef double T;
 
+/************************************************************************/
+class hostedModel;
+
+/************************************************************************/
+// Shared scheduler of the multi-model mode. Models with pending samples are
+// queued here and picked up by the pool workers. A model is queued at most
+// once at a time, so its samples are always processed in order by one worker.
+class modelScheduler
+{
+private:
+    deque<hostedModel*>  ready;
+    Mutex                readyMutex;
+    Semaphore            readyCount;
+    bool                 stopping;
+
+public:
+    modelScheduler() : readyCount(0), stopping(false)
+    {
+    }
+
+    void schedule(hostedModel* model)
+    {
+        readyMutex.lock();
+        ready.push_back(model);
+        readyMutex.unlock();
+        readyCount.post();
+    }
+
+    // Blocks until a model is ready. Returns 0 when the scheduler is stopped.
+    hostedModel* next()
+    {
+        readyCount.wait();
+        readyMutex.lock();
+        hostedModel* model = 0;
+        if (!stopping && !ready.empty())
+        {
+            model = ready.front();
+            ready.pop_front();
+        }
+        readyMutex.unlock();
+        return model;
+    }
+
+    void stop(int numWorkers)
+    {
+        readyMutex.lock();
+        stopping = true;
+        readyMutex.unlock();
+        for (int i = 0 ; i < numWorkers ; ++i)
+            readyCount.post();
+    }
+};
+
+bool configurePerfMetrics(Searchable &rf, unsigned int t, bool trackTrend, perfMetrics &metrics, string &description);
+
+/************************************************************************/
+// A recursive model hosted by the multi-model mode. Samples received on its
+// own input port are copied into a bounded queue in the port callback and
+// processed (predict, evaluate, update) by the shared worker pool.
+class hostedModel : public BufferedPort<Bottle>
+{
+private:
+    modelScheduler*         scheduler;
+    
+    // Bounded sample queue: ring buffer of queueSize samples of d+t elements
+    vector<T>               queue;
+    int                     queueSize;
+    int                     queueHead;
+    int                     queueCount;
+    bool                    scheduled;      // True while the model is queued or being processed
+    Mutex                   queueMutex;     // Protects the queue and the statistics
+    
+    // Workspaces
+    vector<T>               sample;
+    vector<T>               ypred;
+    vector<T>               perfValues;     // Performance values published on perf:o
+    perfMetrics             metrics;        // Performance measures, over the streamed samples only
+    
+    // Statistics
+    long unsigned int       received;
+    long unsigned int       processed;
+    long unsigned int       dropped;
+    double                  busyTime;       // Total processing time [s]
+
+    virtual void onRead(Bottle &b)
+    {
+        bool needsScheduling = false;
+        
+        queueMutex.lock();
+        ++received;
+        if (queueCount == queueSize)
+        {
+            // Queue full: drop the oldest sample
+            queueHead = (queueHead + 1) % queueSize;
+            --queueCount;
+            ++dropped;
+        }
+        T* slot = &queue[((queueHead + queueCount) % queueSize) * (d + t)];
+        for (int i = 0 ; i < d + t ; ++i)
+            slot[i] = (i < b.size()) ? b.get(i).asDouble() : 0.0;
+        ++queueCount;
+        if (!scheduled)
+        {
+            scheduled = true;
+            needsScheduling = true;
+        }
+        queueMutex.unlock();
+        
+        if (needsScheduling)
+            scheduler->schedule(this);
+    }
+
+public:
+    string                  modelName;
+    int                     d;
+    int                     t;
+    recursiveRLSCholesky    estimator;
+    BufferedPort<Bottle>    pred;
+    BufferedPort<Bottle>    perf;
+
+    hostedModel(const string &_modelName, int _d, int _t, double lambda, int _queueSize, modelScheduler* _scheduler)
+        : scheduler(_scheduler), queueSize(_queueSize), queueHead(0), queueCount(0), scheduled(false),
+          received(0), processed(0), dropped(0), busyTime(0.0),
+          modelName(_modelName), d(_d), t(_t), estimator(_d, _t, lambda)
+    {
+        queue.resize(queueSize * (d + t));
+        sample.resize(d + t);
+        ypred.resize(t);
+    }
+
+    // Configures the performance measures with the shared perf, perfGroups, perfTrackers, perfWindow
+    // and perfForget options
+    bool configureMetrics(Searchable &rf)
+    {
+        string description;
+        if (!configurePerfMetrics(rf, t, false, metrics, description))
+            return false;
+        perfValues.assign(metrics.getSize(), 0.0);
+        return true;
+    }
+
+    bool pretrain(const string &trainFilePath, int n_pretr, double holdOut, int nLambda)
+    {
+        try
+        {
+            gMat2D<T> trainSet;
+            trainSet.readCSV(trainFilePath);
+            if ((int)trainSet.rows() < n_pretr || (int)trainSet.cols() < d + t)
+            {
+                printf("Error: Training set of model %s too small!\n", modelName.c_str());
+                return false;
+            }
+            
+            vector<T> Xbuf(n_pretr * d);
+            vector<T> ybuf(n_pretr * t);
+            for (int j = 0 ; j < n_pretr ; ++j)
+            {
+                for (int i = 0 ; i < d ; ++i)
+                    Xbuf[j*d + i] = trainSet(j,i);
+                for (int i = 0 ; i < t ; ++i)
+                    ybuf[j*t + i] = trainSet(j,d + i);
+            }
+            
+            // Normalization of nMSE, as in the single model mode
+            vector<T> mean(t, 0.0), var(t, 0.0);
+            for (int j = 0 ; j < n_pretr ; ++j)
+                for (int i = 0 ; i < t ; ++i)
+                    mean[i] += ybuf[j*t + i] / n_pretr;
+            for (int j = 0 ; j < n_pretr ; ++j)
+                for (int i = 0 ; i < t ; ++i)
+                    var[i] += (ybuf[j*t + i] - mean[i]) * (ybuf[j*t + i] - mean[i]) / n_pretr;
+            metrics.setVariance(&var[0]);
+            
+            return estimator.trainHoldOut(&Xbuf[0], &ybuf[0], n_pretr, holdOut, nLambda);
+        }
+        catch (gException& e)
+        {
+            cout << e.getMessage() << endl;
+            return false;
+        }
+    }
+
+    // Process all the pending samples. Called by one pool worker at a time.
+    void processPending()
+    {
+        double elapsed = 0.0;
+        bool havePrevious = false;
+        
+        while (true)
+        {
+            queueMutex.lock();
+            if (havePrevious)
+            {
+                ++processed;
+                busyTime += elapsed;
+            }
+            if (queueCount == 0)
+            {
+                scheduled = false;
+                queueMutex.unlock();
+                return;
+            }
+            const T* slot = &queue[queueHead * (d + t)];
+            for (int i = 0 ; i < d + t ; ++i)
+                sample[i] = slot[i];
+            queueHead = (queueHead + 1) % queueSize;
+            --queueCount;
+            queueMutex.unlock();
+
+            double t0 = Time::now();
+            const T* x = &sample[0];
+            const T* y = &sample[d];
+            
+            // Prediction
+            estimator.predict(x, &ypred[0]);
+            Bottle& bpred = pred.prepare();
+            bpred.clear();
+            for (int i = 0 ; i < t ; ++i)
+                bpred.addDouble(ypred[i]);
+            pred.write();
+            
+            // Performance
+            metrics.update(y, &ypred[0]);
+            metrics.evaluate(&perfValues[0]);
+            Bottle& bperf = perf.prepare();
+            bperf.clear();
+            for (size_t i = 0 ; i < perfValues.size() ; ++i)
+                bperf.addDouble(perfValues[i]);
+            perf.write();
+            
+            // Update
+            estimator.update(x, y);
+            
+            elapsed = Time::now() - t0;
+            havePrevious = true;
+        }
+    }
+
+    void addStats(Bottle &reply)
+    {
+        queueMutex.lock();
+        Bottle &b = reply.addList();
+        b.addString(modelName.c_str());
+        b.addString("received");
+        b.addInt(received);
+        b.addString("processed");
+        b.addInt(processed);
+        b.addString("dropped");
+        b.addInt(dropped);
+        b.addString("queued");
+        b.addInt(queueCount);
+        b.addString("avgTime_ms");
+        b.addDouble(processed > 0 ? 1000.0 * busyTime / processed : 0.0);
+        queueMutex.unlock();
+    }
+};
+
+/************************************************************************/
+// Worker of the shared pool of the multi-model mode
+class poolWorker : public Thread
+{
+private:
+    modelScheduler* scheduler;
+    rtConfig::settings rt;      // Realtime options
+    size_t index;               // Index of the worker in the pool
+
+public:
+    poolWorker(modelScheduler* _scheduler, const rtConfig::settings &_rt, size_t _index)
+        : scheduler(_scheduler), rt(_rt), index(_index)
+    {
+    }
+
+    bool threadInit()
+    {
+        rtConfig::configureThread(rt, index, "pool worker");
+        return true;
+    }
+
+    void run()
+    {
+        while (!isStopping())
+        {
+            hostedModel* model = scheduler->next();
+            if (model == 0)
+                break;
+            model->processPending();
+        }
+    }
+};
+
+/************************************************************************/
+// Configures the performance measures published on perf:o and computed by the offline experiments:
+// 'perf' is a measure or a list of measures (e.g. (RMSE nMSE:window MAE:decay)), 'perfGroups' an optional list of groups of outputs
+// whose values are averaged, 'perfWindow' and 'perfForget' the horizons of the window and decay measures.
+// The measures without an explicit horizon are published for each tracker of 'perfTrackers', e.g.
+// (cumulative window decay), so that the recent error is published together with the cumulative one.
+bool configurePerfMetrics(Searchable &rf, unsigned int t, bool trackTrend, perfMetrics &metrics, string &description)
+{
+    Bottle perfList;
+    if (rf.find("perf").isList())
+        perfList = *rf.find("perf").asList();
+    else
+        perfList.addString(rf.check("perf",Value("RMSE")).asString());
+    
+    Bottle trackers;
+    if (rf.find("perfTrackers").isList())
+        trackers = *rf.find("perfTrackers").asList();
+    else
+        trackers.addString(rf.check("perfTrackers",Value("cumulative")).asString());
+    
+    // Expand the measures over the trackers
+    Bottle names;
+    for (int i = 0 ; i < perfList.size() ; ++i)
+    {
+        string name = perfList.get(i).asString().c_str();
+        if (name.find(':') != string::npos)
+            names.addString(name.c_str());
+        else
+            for (int k = 0 ; k < trackers.size() ; ++k)
+                names.addString((name + ":" + trackers.get(k).asString().c_str()).c_str());
+    }
+    
+    vector<perfMetrics::measure> measures;
+    for (int i = 0 ; i < names.size() ; ++i)
+    {
+        perfMetrics::measure m;
+        if (perfMetrics::parseMeasure(names.get(i).asString().c_str(), m))
+            measures.push_back(m);
+        else
+            printf("Warning: unknown performance measure %s => ignored\n", names.get(i).asString().c_str());
+    }
+    if (measures.empty())
+    {
+        printf("Error: Inconsistent performance measure! Set to RMSE.\n");
+        perfMetrics::measure m;
+        perfMetrics::parseMeasure("RMSE", m);
+        measures.push_back(m);
+        names.clear();
+        names.addString("RMSE");
+    }
+    
+    vector<vector<unsigned int> > groups;
+    Bottle* groupList = rf.find("perfGroups").asList();
+    if (groupList != 0)
+    {
+        for (int g = 0 ; g < groupList->size() ; ++g)
+        {
+            groups.push_back(vector<unsigned int>());
+            Bottle* idx = groupList->get(g).asList();
+            for (int i = 0 ; idx != 0 && i < idx->size() ; ++i)
+                groups.back().push_back(idx->get(i).asInt());
+        }
+    }
+    
+    int perfWindow = rf.check("perfWindow",Value(100)).asInt();
+    if (perfWindow < 1)
+    {
+        cout << "Warning: perfWindow cannot be lower than 1 => perfWindow=1 is assumed" << endl;
+        perfWindow = 1;
+    }
+    double perfForget = rf.check("perfForget",Value(0.01)).asDouble();
+    if (perfForget <= 0.0 || perfForget > 1.0)
+    {
+        cout << "Warning: perfForget must be in (0,1] => perfForget=0.01 is assumed" << endl;
+        perfForget = 0.01;
+    }
+    
+    if (!metrics.configure(t, measures, groups, perfWindow, perfForget, trackTrend))
+    {
+        printf("Error: Inconsistent perfGroups!\n");
+        return false;
+    }
+    description = names.toString().c_str();
+    return true;
+}
+
+/************************************************************************/
+// Adaptive update policy. A sample is absorbed only if the running a-priori
+// residual exceeds the tolerance, if its leverage x^T A^-1 x (novelty with
+// respect to the absorbed samples) exceeds a threshold, or if maxSkip samples
+// have been skipped in a row, which guarantees a minimum update rate.
+class updateSchedule
+{
+private:
+    bool                adaptive;       // False: every sample is absorbed
+    double              tol;            // Tolerance on the running residual
+    double              novelty;        // Leverage threshold (0: disabled)
+    double              forget;         // Forgetting factor of the running residual
+    int                 maxSkip;        // Maximum number of consecutive skipped samples
+    double              running;        // Exponentially weighted max-abs residual
+    int                 skipped;        // Consecutive skipped samples
+    long unsigned int   updates;        // Absorbed samples
+    long unsigned int   skips;          // Skipped samples
+
+public:
+    updateSchedule() : adaptive(false), tol(0.0), novelty(0.0), forget(0.05), maxSkip(10),
+                       running(0.0), skipped(0), updates(0), skips(0)
+    {
+    }
+    
+    void configure(bool _adaptive, double _tol, double _novelty, double _forget, int _maxSkip)
+    {
+        adaptive = _adaptive;
+        tol = _tol;
+        novelty = _novelty;
+        forget = _forget;
+        maxSkip = _maxSkip;
+        running = 0.0;
+        skipped = 0;
+        updates = 0;
+        skips = 0;
+    }
+    
+    bool isAdaptive() const         { return adaptive; }
+    bool needsLeverage() const      { return adaptive && novelty > 0.0; }
+    long unsigned int getUpdates() const    { return updates; }
+    long unsigned int getSkips() const      { return skips; }
+    
+    // Returns true if the sample with a-priori residual e (size t) and the given leverage must be absorbed
+    bool decide(const T* e, int t, double leverage)
+    {
+        if (!adaptive)
+        {
+            ++updates;
+            return true;
+        }
+        
+        double maxAbs = 0.0;
+        for (int i = 0 ; i < t ; ++i)
+            if (fabs(e[i]) > maxAbs)
+                maxAbs = fabs(e[i]);
+        running += forget * (maxAbs - running);
+        
+        if (running > tol || (novelty > 0.0 && leverage > novelty) || skipped >= maxSkip)
+        {
+            skipped = 0;
+            ++updates;
+            return true;
+        }
+        ++skipped;
+        ++skips;
+        return false;
+    }
+};
+
+/************************************************************************/
+// Normalization limits published by the Normalizer on stats:o, in the format of its [LIMITS] group plus
+// (Frozen 0|1). The estimator keeps the latest ones, so that it can wait for the frozen limits before
+// learning (waitNormFrozen) and save the normalization its model was trained with, for a fixed run.
+class normalizationLimits : public BufferedPort<Bottle>
+{
+private:
+    Mutex               mutex;
+    Bottle              limits;         // (Min ...) (Max ...)
+    bool                received;
+    bool                frozen;
+    
+    virtual void onRead(Bottle &b)
+    {
+        if (b.findGroup("Min").isNull() || b.findGroup("Max").isNull())
+            return;
+        mutex.lock();
+        limits.clear();
+        limits.addList() = b.findGroup("Min");
+        limits.addList() = b.findGroup("Max");
+        bool wasFrozen = frozen;
+        frozen = b.findGroup("Frozen").get(1).asInt() == 1;
+        received = true;
+        mutex.unlock();
+        if (frozen && !wasFrozen)
+            printf("Frozen normalization limits received\n");
+    }
+    
+public:
+    normalizationLimits() : received(false), frozen(false)
+    {
+    }
+    
+    bool isFrozen()
+    {
+        mutex.lock();
+        bool f = frozen;
+        mutex.unlock();
+        return f;
+    }
+    
+    // Appends (Min ...) (Max ...) (Frozen 0|1); returns false if no limits have been received
+    bool addLimits(Bottle &b)
+    {
+        mutex.lock();
+        bool r = received;
+        if (received)
+        {
+            b.addList() = *limits.get(0).asList();
+            b.addList() = *limits.get(1).asList();
+            Bottle &f = b.addList();
+            f.addString("Frozen");
+            f.addInt(frozen ? 1 : 0);
+        }
+        mutex.unlock();
+        return r;
+    }
+    
+    // Writes the limits as a configuration file of the fixed Normalizer
+    bool save(const string &fileName)
+    {
+        Bottle b;
+        if (!addLimits(b))
+            return false;
+        ofstream out(fileName.c_str());
+        if (!out.is_open())
+            return false;
+        out << "Type    fixed" << endl << "d       " << b.get(0).asList()->size() - 1 << endl << endl << "[LIMITS]" << endl;
+        out << b.get(0).asList()->toString().c_str() << endl;
+        out << b.get(1).asList()->toString().c_str() << endl;
+        return true;
+    }
+};
+
 /************************************************************************/
 class RRLSestimator: public RFModule
 {
@@ -53,34 +588,143 @@ protected:
     BufferedPort<Bottle>      inVec;
     BufferedPort<Bottle>      pred;
     BufferedPort<Bottle>      perf;
+    BufferedPort<Bottle>      var;
+    normalizationLimits       normStats;    // stats:i, from the stats:o port of the Normalizer
     Port                      rpcPort;
     
     // Data
     bool verbose;
     int d;
     int t;
-    string perfType;
-    int savedPerfNum;           // Number of saved performance measurements
+    string perfType;            // Published performance measures, as configured
+    int savedPerfNum;           // Number of logged samples (-1: all)
     int numPred;                // Number of saved predictions to peform before module closure
     int pretrain;               // Preliminary batch training required
     string pretrainFile;        // Preliminary batch training file
     int n_pretr;                // Number of pretraining samples
     string pretr_type;          // Pretraining type: 'fromFile' or 'fromStream'
+    double lambda;              // Regularization parameter
+    double holdOut;             // Fraction of the pretraining samples used to select lambda (0: fixed lambda)
+    int nLambda;                // Number of candidate values of lambda
+    int predVar;                // Publish the predictive variance on var:o
+    int varDecimation;          // Publish the predictive variance every varDecimation samples
     long unsigned int updateCount;      // Prediciton number counter
     int experimentCount;
     
     gMat2D<T> trainSet;    
     gMat2D<T> Xtr;    
     gMat2D<T> ytr;    
-    RecursiveRLSCholUpdateWrapper<T> estimator;
-    gMat2D<T> varCols;          // Matrix containing the column-wise variances computed on the training set
+    recursiveRLSCholesky estimator;
+    perfMetrics metrics;        // Performance measures published on perf:o
+    vector<T> perfValues;       // Preallocated performance values
+    double degradeRatio;        // Windowed/cumulative MSE ratio signalling a degradation (0: disabled)
+    bool degraded;              // The ratio is currently above degradeRatio
+    bool waitNormFrozen;        // Do not learn until the Normalizer has frozen its limits
+    string normLimitsFile;      // Normalization limits the model was trained with, saved on close
+    
+    // Shared memory transport
+    bool useShmIn;                  // Read the input from the shared memory channel instead of vec:i
+    shmChannel::reader shmIn;       // Channel created on the output port of the producer (shmFrom)
+    vector<T> shmBuf;               // Preallocated input message
+    Bottle shmBottle;               // Input read from the channel
+    
+    // Realtime configuration and jitter measurement
+    rtConfig::settings rt;                  // Realtime options of the estimation thread
+    rtConfig::jitterHistogram predLatency;  // From the input reception to the written prediction
+    rtConfig::jitterHistogram cycleTime;    // From the input reception to the end of the update
+    
+    /************************************************************************/
+    // Reads the next input sample, from vec:i or from the shared memory channel
+    Bottle* readInput()
+    {
+        if (!useShmIn)
+            return inVec.read();    // blocking call
+        
+        double stamp;
+        if (!shmIn.read(stamp, shmBuf))
+            return 0;
+        shmBottle.clear();
+        for (size_t i = 0 ; i < shmBuf.size() ; ++i)
+            shmBottle.addDouble(shmBuf[i]);
+        return &shmBottle;
+    }
+    
+    gMat2D<T> Xnew;             // Incoming features
+    gMat2D<T> ynew;             // Incoming outputs
+    gMat2D<T> ypred;            // Predicted outputs
+    
+    errorLogger logger;         // Streams the predictions, targets, errors and performance to disk
     
-    gMat2D<T> error;
-    gMat2D<T> storedError;      // Contains the first numErr computed errors
+    // History of the absorbed samples, which can be removed from the model with a downdate
+    Mutex estimatorMutex;       // Protects the estimator and the history (downdates come from the RPC thread)
+    int historyLen;             // Maximum number of samples kept in the history (0: disabled)
+    vector<T> history;          // Ring buffer of historyLen samples [ x , y ]
+    int historyHead;            // Next slot to be written
+    int historyCount;           // Number of samples in the history
+    
+    // Outlier gating
+    outlierGate gate;           // Decides whether each sample is absorbed, skipped or down-weighted
+    vector<T> residual;         // A-priori residual of the incoming sample
+    vector<T> xw;               // Weighted features absorbed by the update
+    vector<T> yw;               // Weighted outputs absorbed by the update
+    
+    // Adaptive update policy
+    updateSchedule schedule;    // Skips the updates of the samples which are already predicted well
+    
+    /************************************************************************/
+    // Slot of the sample of the given age in the history (0: the most recent)
+    T* historySlot(int age)
+    {
+        return &history[((historyHead - 1 - age + historyLen) % historyLen) * (d + t)];
+    }
+    
+    /************************************************************************/
+    // Removes from the model the samples with age in [from, to] (0: the most recent),
+    // one O(d^2) downdate each. Returns the number of removed samples, or -1 if the sample of
+    // age from is not in the history; samples receives the number of samples left in the model.
+    // The range is checked under the lock, since the estimation thread updates the history.
+    int removeSamples(int from, int to, long unsigned int &samples)
+    {
+        estimatorMutex.lock();
+        if (from >= historyCount)
+        {
+            samples = estimator.getSampleCount();
+            estimatorMutex.unlock();
+            return -1;
+        }
+        if (to >= historyCount)
+            to = historyCount - 1;
+        int removed = 0;
+        for (int age = from ; age <= to ; ++age)
+        {
+            const T* slot = historySlot(age);
+            if (!estimator.downdate(slot, slot + d))
+                break;
+            ++removed;
+        }
+        
+        // Compact the history: the older samples take the place of the removed ones
+        for (int age = from + removed ; age < historyCount ; ++age)
+        {
+            const T* src = historySlot(age);
+            T* dst = historySlot(age - removed);
+            for (int i = 0 ; i < d + t ; ++i)
+                dst[i] = src[i];
+        }
+        historyCount -= removed;
+        samples = estimator.getSampleCount();
+        estimatorMutex.unlock();
+        return removed;
+    }
+    
+    // Multi-model mode
+    vector<hostedModel*> models;        // Hosted models (empty in single model mode)
+    modelScheduler       scheduler;     // Scheduler shared by the pool workers
+    vector<poolWorker*>  workers;       // Shared worker pool
 
 public:
     /************************************************************************/
-    RRLSestimator() : estimator("recursiveRLSChol"), updateCount(0)
+    RRLSestimator() : predVar(0), updateCount(0), useShmIn(false)
     {
     }
 
@@ -99,8 +743,71 @@ public:
             reply.addVocab(Vocab::encode("many"));
             reply.addString("Available commands are:");
             reply.addString("help");
+            reply.addString("stats");
+            reply.addString("jitter");
+            reply.addString("normLimits: normalization limits received from the Normalizer");
+            reply.addString("remove n: remove the n most recent samples from the model");
+            reply.addString("removeAt i [j]: remove the sample of age i (0: the most recent), or the ages i..j");
             reply.addString("quit");
         }
+        else if (receivedCmd == "stats")
+        {
+            if (models.empty())
+                reply.addString("Statistics are available in multi-model mode only.");
+            else
+            {
+                reply.addVocab(Vocab::encode("many"));
+                for (size_t k = 0 ; k < models.size() ; ++k)
+                    models[k]->addStats(reply);
+            }
+        }
+        else if (receivedCmd == "remove" || receivedCmd == "removeAt")
+        {
+            int from = 0;
+            int to = 0;
+            if (receivedCmd == "remove")
+                to = command.get(1).asInt() - 1;
+            else
+            {
+                from = command.get(1).asInt();
+                to = (command.size() > 2) ? command.get(2).asInt() : from;
+            }
+            
+            if (!models.empty())
+                reply.addString("Sample removal is available in single model mode only.");
+            else if (command.size() < 2 || from < 0 || to < from)
+                reply.addString("Invalid sample range.");
+            else
+            {
+                long unsigned int samples;
+                int removed = removeSamples(from, to, samples);
+                if (removed < 0)
+                    reply.addString("The requested samples are not in the history.");
+                else
+                {
+                    reply.addString("removed");
+                    reply.addInt(removed);
+                    reply.addString("samples");
+                    reply.addInt((int)samples);
+                }
+            }
+        }
+        else if (receivedCmd == "normLimits")
+        {
+            if (!normStats.addLimits(reply))
+                reply.addString("No normalization limits received.");
+        }
+        else if (receivedCmd == "jitter")
+        {
+            if (!models.empty())
+                reply.addString("Jitter histograms are available in single model mode only.");
+            else
+            {
+                reply.addVocab(Vocab::encode("many"));
+                predLatency.addStats(reply, "prediction");
+                cycleTime.addStats(reply, "cycle");
+            }
+        }
         else if (receivedCmd == "quit")
         {
             reply.addString("Quitting.");
@@ -130,21 +837,16 @@ public:
             return false;
         }
         
-        // Set perf type
-        perfType = rf.check("perf",Value("RMSE")).asString();
-        
-        if ( perfType != "MSE" && perfType != "RMSE" && perfType != "nMSE" )
-        {
-            printf("Error: Inconsistent performance measure! Set to RMSE.\n");
-            perfType = "RMSE";
-        }
+        // Set performance measures
+        if (!configureMetrics(rf))
+            return false;
         
         // Set number of saved performance measurements
         numPred  = rf.check("numPred",Value("-1")).asInt();
         
-        // Set number of saved performance measurements
+        // Set number of logged samples (-1: all)
         savedPerfNum = rf.check("savedPerfNum",Value("0")).asInt();
-        if (savedPerfNum > numPred)
+        if (numPred >= 0 && savedPerfNum > numPred)
         {
             savedPerfNum = numPred;
             cout << "Warning: savedPerfNum > numPred, setting savedPerfNum = numPred" << endl;
@@ -153,6 +855,110 @@ public:
         //experimentCount = rf.check("experimentCount",Value("0")).asInt();
         experimentCount = rf.find("experimentCount").asInt();
         
+        // Set regularization parameter
+        lambda = rf.check("lambda",Value(1.0)).asDouble();
+        if (lambda <= 0.0)
+        {
+            printf("Error: The regularization parameter must be positive!\n");
+            return false;
+        }
+        
+        // Hold-out selection of lambda on the pretraining samples
+        holdOut = rf.check("holdOut",Value(0.2)).asDouble();
+        nLambda = rf.check("nLambda",Value(20)).asInt();
+        if (holdOut < 0.0 || holdOut >= 1.0)
+        {
+            cout << "Warning: holdOut must be in [0,1) => holdOut=0 (fixed lambda) is assumed" << endl;
+            holdOut = 0.0;
+        }
+        if (nLambda < 1)
+        {
+            cout << "Warning: nLambda cannot be lower than 1 => nLambda=20 is assumed" << endl;
+            nLambda = 20;
+        }
+        
+        // Realtime options: memory locking applies to the whole process
+        rt = rtConfig::read(rf);
+        rtConfig::configureProcess(rt);
+        
+        // Multi-model mode: host one independent model per entry of the 'models' list
+        Bottle* modelNames = rf.find("models").asList();
+        if (modelNames != 0 && modelNames->size() > 0)
+            return configureModels(rf, *modelNames);
+        
+        // Set predictive variance publishing preferences
+        predVar = rf.check("predVar",Value("0")).asInt();
+        varDecimation = rf.check("varDecimation",Value("1")).asInt();
+        if (varDecimation < 1)
+            varDecimation = 1;
+        
+        // Set the number of recent samples which can be removed from the model
+        historyLen = rf.check("historyLen",Value(100)).asInt();
+        if (historyLen < 0)
+        {
+            cout << "Warning: historyLen cannot be lower than 0 => historyLen=0 is assumed" << endl;
+            historyLen = 0;
+        }
+        
+        // Set outlier gating preferences
+        outlierGate::scaleType gateScale;
+        outlierGate::actionType gateAction;
+        if (!outlierGate::parseScale(rf.check("gate",Value("none")).asString().c_str(), gateScale))
+        {
+            cout << "Warning: unknown gate => none is assumed" << endl;
+            gateScale = outlierGate::NONE;
+        }
+        if (!outlierGate::parseAction(rf.check("gateAction",Value("skip")).asString().c_str(), gateAction))
+        {
+            cout << "Warning: unknown gateAction => skip is assumed" << endl;
+            gateAction = outlierGate::SKIP;
+        }
+        double gateThreshold = rf.check("gateThreshold",Value(4.0)).asDouble();
+        if (gateThreshold <= 0.0)
+        {
+            cout << "Warning: gateThreshold must be positive => gateThreshold=4.0 is assumed" << endl;
+            gateThreshold = 4.0;
+        }
+        int gateWindow = rf.check("gateWindow",Value(50)).asInt();
+        if (gateWindow < 1)
+        {
+            cout << "Warning: gateWindow cannot be lower than 1 => gateWindow=1 is assumed" << endl;
+            gateWindow = 1;
+        }
+        int gateWarmup = rf.check("gateWarmup",Value(50)).asInt();
+        if (gateWarmup < 0)
+            gateWarmup = 0;
+        double gateForget = rf.check("gateForget",Value(0.01)).asDouble();
+        if (gateForget <= 0.0 || gateForget > 1.0)
+        {
+            cout << "Warning: gateForget must be in (0,1] => gateForget=0.01 is assumed" << endl;
+            gateForget = 0.01;
+        }
+        gate.configure(t, gateScale, gateAction, gateThreshold, gateWindow, gateWarmup, gateForget);
+        
+        // Set the update policy: 'always' or 'adaptive'
+        string updatePolicy = rf.check("updatePolicy",Value("always")).asString().c_str();
+        if (updatePolicy != "always" && updatePolicy != "adaptive")
+        {
+            cout << "Warning: unknown updatePolicy => always is assumed" << endl;
+            updatePolicy = "always";
+        }
+        double updateTol = rf.check("updateTol",Value(0.0)).asDouble();
+        double updateNovelty = rf.check("updateNovelty",Value(0.0)).asDouble();
+        double updateForget = rf.check("updateForget",Value(0.05)).asDouble();
+        if (updateForget <= 0.0 || updateForget > 1.0)
+        {
+            cout << "Warning: updateForget must be in (0,1] => updateForget=0.05 is assumed" << endl;
+            updateForget = 0.05;
+        }
+        int maxSkip = rf.check("maxSkip",Value(10)).asInt();
+        if (maxSkip < 0)
+        {
+            cout << "Warning: maxSkip cannot be lower than 0 => maxSkip=0 is assumed" << endl;
+            maxSkip = 0;
+        }
+        schedule.configure(updatePolicy == "adaptive", updateTol, updateNovelty, updateForget, maxSkip);
+        
         // Set preliminary batch training preferences
         pretrain = rf.check("pretrain",Value("0")).asInt();
         
@@ -175,6 +981,15 @@ public:
         cout << "d = " << d << endl;
         cout << "t = " << t << endl;
         cout << "perf = " << perfType << endl;
+        cout << "lambda = " << lambda << endl;
+        if ( schedule.isAdaptive() )
+            cout << "Adaptive updates: tolerance " << updateTol << ", novelty " << updateNovelty
+                 << ", at least one update every " << maxSkip + 1 << " samples" << endl;
+        if ( gate.isEnabled() )
+            cout << "Outlier gate: " << rf.find("gate").asString() << ", " << (gateAction == outlierGate::SKIP ? "skip" : "downweight")
+                 << " above " << gateThreshold << " scales" << endl;
+        if ( predVar == 1 )
+            cout << "Predictive variance published every " << varDecimation << " samples" << endl;
         if ( pretrain == 1 )
         {
             printf("Pretraining requested\n");
@@ -191,12 +1006,37 @@ public:
         inVec.open((fwslash+name+"/vec:i").c_str());
         printf("inVec opened\n");
         
+        // Shared memory input, from the output port given by shmFrom
+        useShmIn = rf.check("shmFrom");
+        if (useShmIn)
+        {
+            if (!shmIn.open(rf.find("shmFrom").asString().c_str(),
+                            rf.check("shmSlots",Value(64)).asInt(), rf.check("shmMaxSize",Value(4096)).asInt()))
+                return false;
+            printf("Shared memory input from %s\n", rf.find("shmFrom").asString().c_str());
+        }
+        
         pred.open((fwslash+name+"/pred:o").c_str());
         printf("pred opened\n");
         
         perf.open((fwslash+name+"/perf:o").c_str());
         printf("perf opened\n");
         
+        if ( predVar == 1 )
+        {
+            var.open((fwslash+name+"/var:o").c_str());
+            printf("var opened\n");
+        }
+        
+        // Limits of an adaptive Normalizer
+        waitNormFrozen = (rf.check("waitNormFrozen",Value(0)).asInt() == 1);
+        normLimitsFile = rf.check("normLimitsFile",Value("normLimits.ini")).asString().c_str();
+        normStats.useCallback();
+        normStats.open((fwslash+name+"/stats:i").c_str());
+        printf("stats opened\n");
+        if (waitNormFrozen)
+            cout << "The model is not trained or updated until the Normalizer has frozen its limits" << endl;
+        
         rpcPort.open((fwslash+name+"/rpc:i").c_str());
         printf("rpcPort opened\n");
 
@@ -206,18 +1046,42 @@ public:
         // Initialize random number generator
         srand(static_cast<unsigned int>(time(NULL)));
 
+        // Initialize estimator and sample buffers
+        estimator.reset(d, t, lambda);
+        Xnew.resize(1,d);
+        residual.assign(t, 0.0);
+        xw.assign(d, 0.0);
+        yw.assign(t, 0.0);
+        ynew.resize(1,t);
+        ypred.resize(1,t);
+
         // Initialize error structures
-        error.resize(1,t);
-        error = gMat2D<T>::zeros(1, t);          //
+        perfValues.assign(metrics.getSize(), 0.0);
         
-        if (savedPerfNum > 0)
+        if (savedPerfNum != 0)
         {
-            storedError.resize(savedPerfNum,t);
-            storedError = gMat2D<T>::zeros(savedPerfNum, t);          //MSE            
+            std::ostringstream ss;
+            ss << rf.check("logName",Value("storedError")).asString() << experimentCount;
+            string logFormat = rf.check("logFormat",Value("binary")).asString().c_str();
+            if (logFormat != "binary" && logFormat != "csv" && logFormat != "both")
+            {
+                cout << "Warning: unknown logFormat => binary is assumed" << endl;
+                logFormat = "binary";
+            }
+            int logQueue = rf.check("logQueue",Value(1024)).asInt();
+            double logFlush = rf.check("logFlush",Value(1.0)).asDouble();
+            if (!logger.open(ss.str(), t, metrics.getSize(), logFormat != "csv", logFormat != "binary",
+                             logQueue > 0 ? logQueue : 1, logFlush > 0.0 ? logFlush : 1.0))
+                return false;
+            cout << "Logging to " << ss.str() << " (" << logFormat << ")" << endl;
         }
 
         updateCount = 0;
         
+        history.assign(historyLen * (d + t), 0.0);
+        historyHead = 0;
+        historyCount = 0;
+        
         //------------------------------------------
         //         Pre-training
         //------------------------------------------
@@ -295,10 +1159,12 @@ public:
                     }
                     varCols /= n_pretr;     // Compute variance
                     if (verbose) cout << "Variance of the output columns: " << endl << varCols << endl;
+                    metrics.setVariance(varCols.getData());     // Normalization of nMSE
 
                     // Initialize model
                     cout << "Batch pretraining the RLS model with " << n_pretr << " samples." << endl;
-                    estimator.train(Xtr, ytr);
+                    if (!pretrainEstimator())
+                        return false;
                 }
                 
                 catch (gException& e)
@@ -324,12 +1190,24 @@ public:
                     ytr.resize( n_pretr , t );
                     
                     // Initialize Xtr
+                    bool discarding = false;
                     for (int j = 0 ; j < n_pretr ; ++j)
                     {
                         // Wait for input feature vector
                         if(verbose) cout << "Expecting input vector # " << j+1 << endl;
                         
-                        Bottle *bin = inVec.read();    // blocking call
+                        Bottle *bin = readInput();
+                        
+                        // The samples normalized before the freeze are discarded, so that the model is
+                        // pretrained on the same normalization as the online updates
+                        if (bin != 0 && waitNormFrozen && !normStats.isFrozen())
+                        {
+                            if (!discarding)
+                                cout << "Discarding the pretraining samples until the Normalizer has frozen its limits" << endl;
+                            discarding = true;
+                            --j;
+                            continue;
+                        }
                         
                         if (bin != 0)
                         {
@@ -371,33 +1249,174 @@ public:
                     }
                     varCols /= n_pretr;     // Compute variance
                     if (verbose) cout << "Variance of the output columns: " << endl << varCols << endl;
+                    metrics.setVariance(varCols.getData());     // Normalization of nMSE
 
                     // Initialize model
                     cout << "Batch pretraining the RLS model with " << n_pretr << " samples." << endl;
-                    estimator.train(Xtr, ytr);
+                    if (!pretrainEstimator())
+                        return false;
                 }
                 
                 catch (gException& e)
                 {
-                    cout << e.getMessage() << endl;
-                    return false;   // Terminate program. NOTE: May be worth to set up specific error return values
+                    cout << e.getMessage() << endl;
+                    return false;   // Terminate program. NOTE: May be worth to set up specific error return values
+                }
+            }
+            
+            // Print detailed pretraining information
+            if (verbose) 
+                cout << "Pretrained on " << estimator.getSampleCount() << " samples with lambda = " << estimator.getRegParam() << endl;
+        }
+        
+        // updateModule runs in the thread which configures the module
+        rtConfig::configureThread(rt, 0, "estimation");
+        predLatency.reset();
+        cycleTime.reset();
+        
+        return true;
+    }
+
+    /************************************************************************/
+    bool configureMetrics(ResourceFinder &rf)
+    {
+        degradeRatio = rf.check("degradeRatio",Value(0.0)).asDouble();
+        if (degradeRatio < 0.0)
+            degradeRatio = 0.0;
+        degraded = false;
+        return configurePerfMetrics(rf, t, degradeRatio > 0.0, metrics, perfType);
+    }
+
+    /************************************************************************/
+    bool configureModels(ResourceFinder &rf, const Bottle &modelNames)
+    {
+        string name=rf.find("name").asString().c_str();
+        string fwslash="/";
+        int numWorkers = rf.check("numWorkers",Value("2")).asInt();
+        int queueSize = rf.check("queueSize",Value("16")).asInt();
+        if (numWorkers < 1)
+            numWorkers = 1;
+        if (queueSize < 1)
+            queueSize = 1;
+        
+        cout << endl << "-------------------------" << endl;
+        cout << "Multi-model mode: " << modelNames.size() << " models, " << numWorkers << " workers" << endl;
+        cout << "Performance measures: " << perfType << endl;
+        
+        // The hosted models absorb every sample and do not log their errors
+        if (rf.check("gate") && rf.find("gate").asString() != "none")
+            cout << "Warning: the outlier gate is not supported in multi-model mode => ignored" << endl;
+        if (rf.check("updatePolicy") && rf.find("updatePolicy").asString() != "always")
+            cout << "Warning: the adaptive update policy is not supported in multi-model mode => ignored" << endl;
+        if (savedPerfNum != 0)
+            cout << "Warning: error logging (savedPerfNum) is not supported in multi-model mode => ignored" << endl;
+        if (degradeRatio > 0.0)
+            cout << "Warning: degradeRatio is not supported in multi-model mode => ignored" << endl;
+        
+        for (int k = 0 ; k < modelNames.size() ; ++k)
+        {
+            // Each model may override the shared parameters in its own group
+            string modelName = modelNames.get(k).asString().c_str();
+            Bottle &group = rf.findGroup(modelName);
+            int dk = group.check("d",Value(d)).asInt();
+            int tk = group.check("t",Value(t)).asInt();
+            double lambdak = group.check("lambda",Value(lambda)).asDouble();
+            if (dk <= 0 || tk <= 0 || lambdak <= 0.0)
+            {
+                printf("Error: Inconsistent parameters for model %s!\n", modelName.c_str());
+                return false;
+            }
+            
+            hostedModel* model = new hostedModel(modelName, dk, tk, lambdak, queueSize, &scheduler);
+            models.push_back(model);
+            cout << modelName << ": d = " << dk << ", t = " << tk << ", lambda = " << lambdak << endl;
+            if (!model->configureMetrics(rf))
+            {
+                printf("Error: Inconsistent performance measures for model %s!\n", modelName.c_str());
+                return false;
+            }
+            
+            if (group.check("pretrainFile"))
+            {
+                string trainFilePath = rf.getContextPath() + "/data/" + group.find("pretrainFile").asString().c_str();
+                int nk = group.check("n_pretr",Value(rf.check("n_pretr",Value(0)).asInt())).asInt();
+                if (nk < 1)
+                {
+                    printf("Error: n_pretr of model %s must be at least 1!\n", modelName.c_str());
+                    return false;
                 }
+                cout << "Batch pretraining model " << modelName << " with " << nk << " samples." << endl;
+                if (!model->pretrain(trainFilePath, nk, holdOut, nLambda))
+                    return false;
             }
             
-            // Print detailed pretraining information
-            if (verbose) 
-                estimator.getOpt().printAll();
+            model->pred.open((fwslash+name+"/"+modelName+"/pred:o").c_str());
+            model->perf.open((fwslash+name+"/"+modelName+"/perf:o").c_str());
+            model->useCallback();
+            model->open((fwslash+name+"/"+modelName+"/vec:i").c_str());
+        }
+        cout << "-------------------------" << endl << endl;
+        
+        for (int i = 0 ; i < numWorkers ; ++i)
+        {
+            workers.push_back(new poolWorker(&scheduler, rt, i));
+            workers.back()->start();
         }
         
+        rpcPort.open((fwslash+name+"/rpc:i").c_str());
+        attach(rpcPort);
+        
         return true;
     }
 
+    /************************************************************************/
+    bool pretrainEstimator()
+    {
+        // Copy the training set in row-major order, as required by the estimator
+        vector<T> Xbuf(n_pretr * d);
+        vector<T> ybuf(n_pretr * t);
+        for (int j = 0 ; j < n_pretr ; ++j)
+        {
+            for (int i = 0 ; i < d ; ++i)
+                Xbuf[j*d + i] = Xtr(j,i);
+            for (int i = 0 ; i < t ; ++i)
+                ybuf[j*t + i] = ytr(j,i);
+        }
+        
+        return estimator.trainHoldOut(&Xbuf[0], &ybuf[0], n_pretr, holdOut, nLambda);
+    }
+
     /************************************************************************/
     bool close()
     {        
+        if (!models.empty())
+        {
+            scheduler.stop(workers.size());
+            for (size_t i = 0 ; i < workers.size() ; ++i)
+            {
+                workers[i]->stop();
+                delete workers[i];
+            }
+            workers.clear();
+            
+            for (size_t k = 0 ; k < models.size() ; ++k)
+            {
+                models[k]->close();
+                models[k]->pred.close();
+                models[k]->perf.close();
+                delete models[k];
+            }
+            models.clear();
+            
+            rpcPort.close();
+            printf("rpcPort closed\n");
+            return true;
+        }
+        
         // Close ports
         inVec.close();
         printf("inVec closed\n");
+        shmIn.close();
         
         pred.close();
         printf("pred closed\n");
@@ -405,8 +1424,32 @@ public:
         perf.close();
         printf("perf closed\n");
         
+        if ( predVar == 1 )
+        {
+            var.close();
+            printf("var closed\n");
+        }
+        
+        normStats.close();
+        if (normStats.save(normLimitsFile))
+            cout << "Normalization limits of the model saved to " << normLimitsFile << endl;
+        
         rpcPort.close();
         printf("rpcPort closed\n");
+        
+        if (logger.isOpen())
+        {
+            logger.close();
+            cout << "Error log closed: " << logger.getWritten() << " samples written, " << logger.getDropped() << " dropped." << endl;
+        }
+        
+        if (predLatency.getCount() > 0)
+        {
+            predLatency.print("Prediction latency");
+            cycleTime.print("Cycle time");
+        }
+        if (schedule.isAdaptive())
+            printf("Adaptive updates: %lu samples absorbed, %lu skipped\n", schedule.getUpdates(), schedule.getSkips());
 
         return true;
     }
@@ -414,8 +1457,8 @@ public:
     /************************************************************************/
     double getPeriod()
     {
-        // Period in seconds
-        return 0.0;
+        // Period in seconds. In multi-model mode the work is done by the pool workers.
+        return models.empty() ? 0.0 : 1.0;
     }
 
     /************************************************************************/
@@ -427,6 +1470,9 @@ public:
     /************************************************************************/
     bool updateModule()
     {
+        if (!models.empty())
+            return true;
+        
         ++updateCount;
         
         if (updateCount > numPred)
@@ -440,20 +1486,14 @@ public:
         if(verbose) cout << "updateModule #" << updateCount << endl;
 
 
-        // Recursive update support and storage variables declaration and initialization
-        gMat2D<T> Xnew(1,d);
-        gMat2D<T> ynew(1,t);
-        gVec<T> Xnew_v(d);
-        gVec<T> ynew_v(t);
-        gMat2D<T> *resptr = 0;
-        
         // Wait for input feature vector
         if(verbose) cout << "Expecting input vector" << endl;
         
-        Bottle *bin = inVec.read();    // blocking call
+        Bottle *bin = readInput();
         
         if (bin != 0)
         {
+            double tIn = Time::now();
             if(verbose) cout << "Got it!" << endl << bin->toString() << endl;
 
             //Store the received sample in gMat2D format for it to be compatible with gurls++
@@ -480,89 +1520,104 @@ public:
             //-----------------------------------
             
             // Test on the incoming sample
-            resptr = estimator.eval(Xnew);
+            estimatorMutex.lock();
+            estimator.predict(Xnew.getData(), ypred.getData());
             
             Bottle& bpred = pred.prepare(); // Get a place to store things.
             bpred.clear();  // clear is important - b might be a reused object
 
             for (int i = 0 ; i < t ; ++i)
             {
-                bpred.addDouble((*resptr)(0 , i));
+                bpred.addDouble(ypred(0 , i));
             }
             
             if(verbose) printf("Sending prediction!!! %s\n", bpred.toString().c_str());
             pred.write();
+            predLatency.record(Time::now() - tIn);
             if(verbose) printf("Prediction written to port\n");
 
             //----------------------------------
-            // performance
+            // Predictive variance
+            
+            // Reuses the Cholesky factor of the estimator: one triangular solve, O(d^2)
+            if ( predVar == 1 && (updateCount % varDecimation == 0) )
+            {
+                Bottle& bvar = var.prepare();
+                bvar.clear();
+                bvar.addDouble(estimator.predictiveVariance(Xnew.getData()));
+                var.write();
+            }
 
-            Bottle& bperf = perf.prepare(); // Get a place to store things.
-            bperf.clear();  // clear is important - b might be a reused object
-    
-            if (perfType == "nMSE")     // WARNING: The estimated variance could be unreliable...
+            //----------------------------------
+            // Outlier gating
+            
+            // Weight of the sample in the update: 1 (absorb), 0 (skip) or in between (down-weight)
+            double weight = 1.0;
+            for (int i = 0 ; i < t ; ++i)
+                residual[i] = ynew(0,i) - ypred(0,i);
+            if (gate.isEnabled())
             {
-                // Compute nMSE and store
-                //NOTE: In GURLS, "/" operator works like matlab's "\".
-                error += varCols / ( ynew - *resptr )*( ynew - *resptr ) ;   
-                gMat2D<T> tmp = error  / (updateCount);   // WARNING: Check
-                for (int i = 0 ; i < t ; ++i)
-                {
-                    bperf.addDouble(tmp(0 , i));
-                }
+                weight = gate.evaluate(&residual[0]);
+                if (verbose && weight < 1.0)
+                    cout << "Outlier: sample weight " << weight << endl;
             }
-            else if (perfType == "RMSE")
+            
+            // Learning waits for the final normalization
+            if (waitNormFrozen && !normStats.isFrozen())
+                weight = 0.0;
+            
+            // Adaptive update policy, on the samples which passed the gate
+            if (weight > 0.0)
             {
-                gMat2D<T> tmp(1,t);
-                tmp = ( ynew - *resptr )*( ynew - *resptr );
-                
-                //error = ( error * (updateCount-1) + sqrt(( ynew - *resptr )*( ynew - *resptr )) ) / updateCount;
-                
-                error = error * (updateCount-1);
-                for (int i = 0 ; i < ynew.cols() ; ++i)
-                    error(0,i) += sqrt(tmp(0,i));
-                error = error / updateCount;
-                
-/*                for (int i = 0 ; i < t ; ++i)
-                {
-                    bperf.addDouble(sqrt(MSE(0 , i)));
-                }      */
-
-                // WARNING: Temporary avg RMSE computation
-                
-                bperf.addDouble( (error(0 , 0) + error(0 , 1) + error(0 , 2))/ 3.0);    // Average MSE on forces
-                bperf.addDouble( (error(0 , 3) + error(0 , 4) + error(0 , 5))/ 3.0);    // Average MSE on torques
+                double leverage = schedule.needsLeverage() ? estimator.predictiveVariance(Xnew.getData()) : 0.0;
+                if (!schedule.decide(&residual[0], t, leverage))
+                    weight = 0.0;
             }
-            else if (perfType == "MSE")
+
+            //----------------------------------
+            // performance
+
+            Bottle& bperf = perf.prepare(); // Get a place to store things.
+            bperf.clear();  // clear is important - b might be a reused object
+    
+            // One pass over the residual, in O(t)
+            metrics.update(ynew.getData(), ypred.getData());
+            metrics.evaluate(&perfValues[0]);
+            for (size_t i = 0 ; i < perfValues.size() ; ++i)
+                bperf.addDouble(perfValues[i]);
+            
+            // Degradation: the error of the last window is much larger than the cumulative one
+            if (degradeRatio > 0.0)
             {
-                //Compute MSE and store
-                
-                error = ( error * (updateCount-1) + ( ynew - *resptr )*( ynew - *resptr ) ) / updateCount;
-                for (int i = 0 ; i < t ; ++i)
-                {
-                    bperf.addDouble(error(0 , i));
-                }
-                
+                double trend = metrics.getTrend();
+                if (!degraded && trend > degradeRatio)
+                    printf("Warning: the MSE of the last window is %.1f times the cumulative one => possible degradation\n", trend);
+                else if (degraded && trend <= degradeRatio)
+                    printf("The MSE of the last window is back within %.1f times the cumulative one\n", degradeRatio);
+                degraded = trend > degradeRatio;
+                bperf.addDouble(trend);
             }
             
-            // Error storage matrix management
-            // Update error storage matrix
-            if (updateCount <= savedPerfNum)
+            // Rejection counts of the outlier gate
+            if (gate.isEnabled())
             {
-                gVec<T> errRow = error[0];
-                storedError.setRow( errRow, updateCount-1);
+                bperf.addInt((int)gate.getRejected());
+                bperf.addInt((int)gate.getDownweighted());
             }
             
-            // Save to CSV file
-            if (updateCount == savedPerfNum)    
+            // Updates skipped by the adaptive policy
+            if (schedule.isAdaptive())
+                bperf.addInt((int)schedule.getSkips());
+            
+            // Error log, written by the logger thread
+            if (logger.isOpen() && (savedPerfNum < 0 || (int)updateCount <= savedPerfNum))
             {
-                
-                std::ostringstream ss;
-                ss << experimentCount;
-                
-                //string tmp(std::to_string(experimentCount));
-                storedError.saveCSV("storedError" + ss.rdbuf()->str() + ".csv");
-                cout << "Error measurement matrix saved." << endl;
+                logger.push(updateCount, tIn, ypred.getData(), ynew.getData(), &perfValues[0]);
+                if ((int)updateCount == savedPerfNum)
+                {
+                    logger.close();
+                    cout << "Error log completed." << endl;
+                }
             }
             
             // Write computed error to output port
@@ -578,7 +1633,32 @@ public:
             if(verbose) cout << "Now performing RRLS update" << endl;            
             if(verbose) cout << "Xnew" << Xnew << endl;            
             if(verbose) cout << "ynew" << ynew << endl;            
-            estimator.update(Xnew, ynew);
+            if (weight > 0.0)
+            {
+                // A weight w is applied by absorbing (sqrt(w) x, sqrt(w) y)
+                const double sw = sqrt(weight);
+                for (int i = 0 ; i < d ; ++i)
+                    xw[i] = sw * Xnew(0,i);
+                for (int i = 0 ; i < t ; ++i)
+                    yw[i] = sw * ynew(0,i);
+                estimator.update(&xw[0], &yw[0]);
+                
+                // Keep the absorbed sample in the history, for a later downdate
+                if (historyLen > 0)
+                {
+                    T* slot = &history[historyHead * (d + t)];
+                    for (int i = 0 ; i < d ; ++i)
+                        slot[i] = xw[i];
+                    for (int i = 0 ; i < t ; ++i)
+                        slot[d + i] = yw[i];
+                    historyHead = (historyHead + 1) % historyLen;
+                    if (historyCount < historyLen)
+                        ++historyCount;
+                }
+            }
+            else if(verbose) cout << "Update skipped" << endl;
+            estimatorMutex.unlock();
+            cycleTime.record(Time::now() - tIn);
             if(verbose) cout << "Update completed" << endl;            
         }
 
@@ -593,8 +1673,22 @@ public:
     /************************************************************************/
     bool interruptModule()
     {
+        if (!models.empty())
+        {
+            for (size_t k = 0 ; k < models.size() ; ++k)
+            {
+                models[k]->interrupt();
+                models[k]->pred.interrupt();
+                models[k]->perf.interrupt();
+            }
+            rpcPort.interrupt();
+            printf("rpcPort interrupted\n");
+            return true;
+        }
+        
         inVec.interrupt();
         printf("inVec interrupted\n");
+        shmIn.interrupt();
 
         pred.interrupt();
         printf("pred interrupted\n");
@@ -602,6 +1696,12 @@ public:
         perf.interrupt();
         printf("perf interrupted\n");
         
+        if ( predVar == 1 )
+        {
+            var.interrupt();
+            printf("var interrupted\n");
+        }
+        
         rpcPort.interrupt();
         printf("rpcPort interrupted\n");
 
@@ -610,14 +1710,452 @@ public:
 };
 
 /************************************************************************/
-int main(int argc, char *argv[])
+// Times the recursive update on random samples for several feature and output
+// sizes. Since all the outputs share a single Cholesky factor, the cost per
+// sample must scale with d^2 and be (almost) independent of t.
+int runUpdateBenchmark(ResourceFinder &rf)
 {
-    Network yarp;
-    if (!yarp.checkNetwork())
+    Bottle dList;
+    Bottle tList;
+    dList.fromString("250 500 1000");
+    tList.fromString("1 6 24");
+    if (rf.find("benchD").isList())
+        dList = *rf.find("benchD").asList();
+    else if (rf.check("benchD"))
     {
-        printf("YARP server not available!\n");
+        dList.clear();
+        dList.addInt(rf.find("benchD").asInt());
+    }
+    if (rf.find("benchT").isList())
+        tList = *rf.find("benchT").asList();
+    else if (rf.check("benchT"))
+    {
+        tList.clear();
+        tList.addInt(rf.find("benchT").asInt());
+    }
+    int benchN = rf.check("benchN",Value(200)).asInt();
+    
+    printf("Recursive update benchmark, %d samples per configuration\n", benchN);
+    printf("%8s %8s %16s %16s\n", "d", "t", "us/sample", "ns/(sample*d^2)");
+    for (int i = 0 ; i < dList.size() ; ++i)
+    {
+        int d = dList.get(i).asInt();
+        for (int j = 0 ; j < tList.size() ; ++j)
+        {
+            int t = tList.get(j).asInt();
+            recursiveRLSCholesky estimator(d, t, 1.0);
+            vector<T> X(benchN * d);
+            vector<T> y(benchN * t);
+            for (size_t k = 0 ; k < X.size() ; ++k)
+                X[k] = 2.0 * rand() / RAND_MAX - 1.0;
+            for (size_t k = 0 ; k < y.size() ; ++k)
+                y[k] = 2.0 * rand() / RAND_MAX - 1.0;
+            
+            double t0 = Time::now();
+            for (int k = 0 ; k < benchN ; ++k)
+                estimator.update(&X[k*d], &y[k*t]);
+            double perSample = (Time::now() - t0) / benchN;
+            
+            printf("%8d %8d %16.1f %16.3f\n", d, t, 1e6 * perSample, 1e9 * perSample / ((double)d*d));
+        }
+    }
+    return 0;
+}
+
+/************************************************************************/
+// Runs predict and update at a fixed period on random samples and records the
+// wake-up lateness of the loop and the compute time of each cycle.
+void runJitterLoop(recursiveRLSCholesky &estimator, const vector<T> &X, const vector<T> &y, int numSamples,
+                   int benchN, double period, rtConfig::jitterHistogram &wakeup, rtConfig::jitterHistogram &compute)
+{
+    int d = estimator.getFeatureSize();
+    int t = estimator.getOutputSize();
+    vector<T> ypred(t);
+    
+    double next = Time::now();
+    for (int k = 0 ; k < benchN ; ++k)
+    {
+        next += period;
+        double now = Time::now();
+        if (next > now)
+            Time::delay(next - now);
+        double t0 = Time::now();
+        wakeup.record(t0 - next);
+        
+        int j = k % numSamples;
+        estimator.predict(&X[j*d], &ypred[0]);
+        estimator.update(&X[j*d], &y[j*t]);
+        compute.record(Time::now() - t0);
+    }
+}
+
+/************************************************************************/
+// Measures the jitter of the estimation loop with the default scheduling, then
+// with the realtime options given in the configuration or on the command line.
+int runJitterBenchmark(ResourceFinder &rf)
+{
+    int d = rf.check("d",Value(300)).asInt();
+    int t = rf.check("t",Value(6)).asInt();
+    int benchN = rf.check("benchN",Value(5000)).asInt();
+    double period = rf.check("benchPeriod",Value(0.002)).asDouble();
+    rtConfig::settings rt = rtConfig::read(rf);
+    if (d <= 0 || t <= 0 || benchN <= 0 || period <= 0.0)
+    {
+        printf("Error: Inconsistent benchmark parameters!\n");
+        return -1;
+    }
+    
+    // Random samples, generated in advance
+    int numSamples = benchN < 1000 ? benchN : 1000;
+    vector<T> X(numSamples * d);
+    vector<T> y(numSamples * t);
+    for (size_t k = 0 ; k < X.size() ; ++k)
+        X[k] = 2.0 * rand() / RAND_MAX - 1.0;
+    for (size_t k = 0 ; k < y.size() ; ++k)
+        y[k] = 2.0 * rand() / RAND_MAX - 1.0;
+    
+    printf("Jitter benchmark: d = %d, t = %d, %d cycles with period %.3f ms\n\n", d, t, benchN, 1000.0 * period);
+    
+    recursiveRLSCholesky estimator(d, t, 1.0);
+    rtConfig::jitterHistogram wakeup, compute;
+    runJitterLoop(estimator, X, y, numSamples, benchN, period, wakeup, compute);
+    printf("Default scheduling\n");
+    wakeup.print("Wake-up lateness");
+    compute.print("Compute time");
+    
+    if (!rt.enabled())
+    {
+        printf("\nNo realtime option given (e.g. --rtCpu 2 --rtPriority 80 --rtLockMemory 1): skipping the realtime run\n");
+        return 0;
+    }
+    
+    printf("\n");
+    rtConfig::configureProcess(rt);
+    rtConfig::configureThread(rt, 0, "estimation");
+    estimator.reset(d, t, 1.0);
+    wakeup.reset();
+    compute.reset();
+    runJitterLoop(estimator, X, y, numSamples, benchN, period, wakeup, compute);
+    printf("\nRealtime configuration\n");
+    wakeup.print("Wake-up lateness");
+    compute.print("Compute time");
+    return 0;
+}
+
+/************************************************************************/
+// Reads a recorded stream: one sample [ x , y ] of width elements per line,
+// separated by spaces, tabs or commas. Returns the number of samples.
+long unsigned int loadSamples(const string &path, int width, vector<T> &data)
+{
+    ifstream in(path.c_str());
+    if (!in.is_open())
+    {
+        printf("Error: cannot open %s\n", path.c_str());
+        return 0;
+    }
+    
+    data.clear();
+    string line;
+    long unsigned int n = 0;
+    while (getline(in, line))
+    {
+        for (size_t i = 0 ; i < line.size() ; ++i)
+            if (line[i] == ',')
+                line[i] = ' ';
+        istringstream ss(line);
+        T v;
+        int cols = 0;
+        while (cols < width && ss >> v)
+        {
+            data.push_back(v);
+            ++cols;
+        }
+        if (cols == 0)
+            continue;       // empty line
+        if (cols < width)
+        {
+            printf("Warning: line %lu of %s has %d elements instead of %d => ignored\n", n + 1, path.c_str(), cols, width);
+            data.resize(n * width);
+            continue;
+        }
+        ++n;
+    }
+    return n;
+}
+
+/************************************************************************/
+// Offline experiments: the recorded stream is replayed, in an independent random
+// order for each experiment, into one estimator per experiment. The experiments
+// run in parallel on a pool of threads and share the read-only samples.
+struct offlineSetup
+{
+    int d;
+    int t;
+    double lambda;
+    int n_pretr;                        // Samples used for the batch pretraining (0: none)
+    double holdOut;                     // Fraction of them used to select lambda (0: fixed lambda)
+    int nLambda;                        // Number of candidate values of lambda
+    int stride;                         // Samples between two points of the error curves
+    bool shuffle;                       // Replay the samples in a random order
+    unsigned int seed;                  // Seed of experiment k is seed + k
+    perfMetrics metrics;                // Configured performance measures, copied by each experiment
+    
+    vector<T> data;                     // Recorded samples [ x , y ], row-major
+    long unsigned int n;                // Number of recorded samples
+    
+    int numPoints;                      // Points of each error curve
+    int curveWidth;                     // Performance values per point
+    vector< vector<T> > curves;         // Error curve of each experiment (numPoints x curveWidth)
+    
+    Mutex nextMutex;
+    int next;                           // Next experiment to be run
+    int numExperiments;
+};
+
+/************************************************************************/
+void runOfflineExperiment(offlineSetup &setup, int k)
+{
+    const int d = setup.d;
+    const int t = setup.t;
+    
+    perfMetrics metrics = setup.metrics;
+    
+    recursiveRLSCholesky estimator(d, t, setup.lambda);
+    if (setup.n_pretr > 0)
+    {
+        vector<T> Xbuf(setup.n_pretr * d);
+        vector<T> ybuf(setup.n_pretr * t);
+        for (int j = 0 ; j < setup.n_pretr ; ++j)
+        {
+            for (int i = 0 ; i < d ; ++i)
+                Xbuf[j*d + i] = setup.data[j*(d + t) + i];
+            for (int i = 0 ; i < t ; ++i)
+                ybuf[j*t + i] = setup.data[j*(d + t) + d + i];
+        }
+        if (!estimator.trainHoldOut(&Xbuf[0], &ybuf[0], setup.n_pretr, setup.holdOut, setup.nLambda))
+            printf("Warning: pretraining of experiment %d failed => starting from scratch\n", k + 1);
+    }
+    
+    // Order of the streamed samples
+    vector<long unsigned int> order;
+    for (long unsigned int j = setup.n_pretr ; j < setup.n ; ++j)
+        order.push_back(j);
+    if (setup.shuffle)
+    {
+        mt19937 rng(setup.seed + k);
+        std::shuffle(order.begin(), order.end(), rng);
+    }
+    
+    vector<T> ypred(t);
+    vector<T> values(metrics.getSize());
+    vector<T> &curve = setup.curves[k];
+    for (size_t j = 0 ; j < order.size() ; ++j)
+    {
+        const T* x = &setup.data[order[j] * (d + t)];
+        const T* y = x + d;
+        estimator.predict(x, &ypred[0]);
+        metrics.update(y, &ypred[0]);
+        estimator.update(x, y);
+        
+        if ((j + 1) % setup.stride == 0 && (int)((j + 1) / setup.stride) <= setup.numPoints)
+        {
+            metrics.evaluate(&values[0]);
+            T* point = &curve[((j + 1) / setup.stride - 1) * setup.curveWidth];
+            for (int i = 0 ; i < setup.curveWidth ; ++i)
+                point[i] = values[i];
+        }
+    }
+}
+
+/************************************************************************/
+class offlineWorker : public Thread
+{
+private:
+    offlineSetup* setup;
+    rtConfig::settings rt;
+    size_t index;
+
+public:
+    offlineWorker(offlineSetup* _setup, const rtConfig::settings &_rt, size_t _index)
+        : setup(_setup), rt(_rt), index(_index)
+    {
+    }
+
+    bool threadInit()
+    {
+        rtConfig::configureThread(rt, index, "offline worker");
+        return true;
+    }
+
+    void run()
+    {
+        // Runs until no experiment is left; stop() only joins the thread
+        while (true)
+        {
+            setup->nextMutex.lock();
+            int k = setup->next++;
+            setup->nextMutex.unlock();
+            if (k >= setup->numExperiments)
+                break;
+            
+            double t0 = Time::now();
+            runOfflineExperiment(*setup, k);
+            printf("Experiment %d completed in %.2f s\n", k + 1, Time::now() - t0);
+        }
+    }
+};
+
+/************************************************************************/
+// Runs numExperiments offline experiments on the recorded stream given by
+// 'offline', without YARP ports, and writes the mean, standard deviation,
+// minimum and maximum over the experiments of each point of the error curves.
+int runOfflineExperiments(ResourceFinder &rf)
+{
+    offlineSetup setup;
+    setup.d = rf.check("d",Value(0)).asInt();
+    setup.t = rf.check("t",Value(0)).asInt();
+    setup.lambda = rf.check("lambda",Value(1.0)).asDouble();
+    setup.n_pretr = (rf.check("pretrain",Value(0)).asInt() == 1) ? rf.check("n_pretr",Value(0)).asInt() : 0;
+    setup.holdOut = rf.check("holdOut",Value(0.2)).asDouble();
+    setup.nLambda = rf.check("nLambda",Value(20)).asInt();
+    setup.stride = rf.check("offlineStride",Value(10)).asInt();
+    setup.shuffle = rf.check("offlineShuffle",Value(1)).asInt() != 0;
+    setup.seed = rf.check("offlineSeed",Value(1)).asInt();
+    setup.numExperiments = rf.check("numExperiments",Value(1)).asInt();
+    setup.next = 0;
+    int numWorkers = rf.check("offlineWorkers",Value(0)).asInt();
+    string outFile = rf.check("offlineOut",Value("offlineErrors.csv")).asString().c_str();
+    
+    if (setup.d <= 0 || setup.t <= 0 || setup.lambda <= 0.0 || setup.stride < 1 || setup.numExperiments < 1 || setup.n_pretr < 0 ||
+        setup.holdOut < 0.0 || setup.holdOut >= 1.0 || setup.nLambda < 1)
+    {
+        printf("Error: Inconsistent offline experiment parameters!\n");
+        return -1;
+    }
+    if (numWorkers <= 0)
+        numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numWorkers > setup.numExperiments)
+        numWorkers = setup.numExperiments;
+    
+    // Recorded stream, looked up in the context like the pretraining file
+    string dataFile = rf.find("offline").asString().c_str();
+    string dataPath = rf.findFile(dataFile.c_str()).c_str();
+    if (dataPath.empty())
+        dataPath = rf.getContextPath() + "/data/" + dataFile;
+    setup.n = loadSamples(dataPath, setup.d + setup.t, setup.data);
+    if ((long unsigned int)setup.n_pretr >= setup.n)
+    {
+        printf("Error: %s contains %lu samples, not enough for %d pretraining samples!\n", dataPath.c_str(), setup.n, setup.n_pretr);
+        return -1;
+    }
+    
+    string description;
+    if (!configurePerfMetrics(rf, setup.t, false, setup.metrics, description))
+        return -1;
+    
+    // The normalization of nMSE is estimated on the pretraining samples, as in the online mode
+    if (setup.n_pretr > 0)
+    {
+        vector<T> var(setup.t, 0.0);
+        vector<T> mean(setup.t, 0.0);
+        for (int j = 0 ; j < setup.n_pretr ; ++j)
+            for (int i = 0 ; i < setup.t ; ++i)
+                mean[i] += setup.data[j*(setup.d + setup.t) + setup.d + i] / setup.n_pretr;
+        for (int j = 0 ; j < setup.n_pretr ; ++j)
+            for (int i = 0 ; i < setup.t ; ++i)
+            {
+                T dev = setup.data[j*(setup.d + setup.t) + setup.d + i] - mean[i];
+                var[i] += dev * dev / setup.n_pretr;
+            }
+        setup.metrics.setVariance(&var[0]);
+    }
+    
+    setup.curveWidth = setup.metrics.getSize();
+    setup.numPoints = (setup.n - setup.n_pretr) / setup.stride;
+    setup.curves.assign(setup.numExperiments, vector<T>(setup.numPoints * setup.curveWidth, 0.0));
+    
+    printf("Offline experiments: %d experiments on %lu samples of %s (%d for pretraining), %d workers\n",
+           setup.numExperiments, setup.n, dataPath.c_str(), setup.n_pretr, numWorkers);
+    printf("Performance measures: %s\n", description.c_str());
+    
+    rtConfig::settings rt = rtConfig::read(rf);
+    rtConfig::configureProcess(rt);
+    double t0 = Time::now();
+    vector<offlineWorker*> workers;
+    for (int i = 0 ; i < numWorkers ; ++i)
+    {
+        workers.push_back(new offlineWorker(&setup, rt, i));
+        workers.back()->start();
+    }
+    for (size_t i = 0 ; i < workers.size() ; ++i)
+    {
+        workers[i]->stop();     // Joins the worker, which returns when no experiment is left
+        delete workers[i];
+    }
+    printf("All the experiments completed in %.2f s\n", Time::now() - t0);
+    
+    // Aggregate the error curves
+    ofstream out(outFile.c_str());
+    if (!out.is_open())
+    {
+        printf("Error: cannot open %s\n", outFile.c_str());
         return -1;
     }
+    out << "sample";
+    for (int i = 0 ; i < setup.curveWidth ; ++i)
+        out << ",mean" << i << ",std" << i << ",min" << i << ",max" << i;
+    out << endl;
+    out << setprecision(10);
+    vector<T> last(4 * setup.curveWidth, 0.0);
+    for (int p = 0 ; p < setup.numPoints ; ++p)
+    {
+        out << (p + 1) * setup.stride;
+        for (int i = 0 ; i < setup.curveWidth ; ++i)
+        {
+            T mean = 0.0, sq = 0.0, mn = 0.0, mx = 0.0;
+            for (int k = 0 ; k < setup.numExperiments ; ++k)
+            {
+                T v = setup.curves[k][p * setup.curveWidth + i];
+                mean += v;
+                sq += v * v;
+                if (k == 0 || v < mn)
+                    mn = v;
+                if (k == 0 || v > mx)
+                    mx = v;
+            }
+            mean /= setup.numExperiments;
+            T var = sq / setup.numExperiments - mean * mean;
+            T std = (var > 0.0) ? sqrt(var) : 0.0;
+            out << "," << mean << "," << std << "," << mn << "," << mx;
+            last[4*i] = mean; last[4*i + 1] = std; last[4*i + 2] = mn; last[4*i + 3] = mx;
+        }
+        out << endl;
+    }
+    printf("Error curves written to %s\n", outFile.c_str());
+    
+    if (setup.numPoints > 0)
+    {
+        printf("Final performance over the experiments:\n");
+        for (int i = 0 ; i < setup.curveWidth ; ++i)
+            printf("  %d) mean %g, std %g, min %g, max %g\n", i, last[4*i], last[4*i + 1], last[4*i + 2], last[4*i + 3]);
+    }
+    return 0;
+}
+
+/************************************************************************/
+int main(int argc, char *argv[])
+{
+    // The benchmark does not need the YARP network
+    {
+        ResourceFinder rf;
+        rf.configure(argc,argv);
+        if (rf.check("benchmark"))
+            return runUpdateBenchmark(rf);
+        if (rf.check("jitterBenchmark"))
+            return runJitterBenchmark(rf);
+    }
+    
+    Network yarp;
 
     ResourceFinder rf;
     rf.setVerbose(true);
@@ -625,6 +2163,16 @@ int main(int argc, char *argv[])
     rf.setDefaultContext("iRRLS");
     rf.setDefault("name","RRLSestimator");
     rf.configure(argc,argv);
+    
+    // The offline experiments replay a recorded stream without YARP ports
+    if (rf.check("offline"))
+        return runOfflineExperiments(rf);
+    
+    if (!yarp.checkNetwork())
+    {
+        printf("YARP server not available!\n");
+        return -1;
+    }
 
     // Set number of experiments
     int numPred = rf.check("numPred",Value("-1")).asInt();    
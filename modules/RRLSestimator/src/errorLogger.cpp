@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include "errorLogger.h"
+#include <yarp/os/Time.h>
+
+using namespace std;
+using namespace yarp::os;
+
+errorLogger::errorLogger() : t(0), p(0), width(0), flushPeriod(1.0), binFile(0), csvFile(0),
+                             capacity(0), head(0), count(0), pending(0), pushed(0), written(0), dropped(0)
+{
+}
+
+errorLogger::~errorLogger()
+{
+    close();
+}
+
+/*************************************************************************************************/
+bool errorLogger::open(const string &baseName, unsigned int nOutputs, unsigned int nPerf, bool binary, bool csv,
+                       unsigned int ringSize, double _flushPeriod)
+{
+    t = nOutputs;
+    p = nPerf;
+    width = 2 + 3*t + p;
+    flushPeriod = _flushPeriod;
+    capacity = (ringSize > 0) ? ringSize : 1;
+    ring.assign(capacity * width, 0.0);
+    head = 0;
+    count = 0;
+    pushed = written = dropped = 0;
+
+    if (binary)
+    {
+        binFile = fopen((baseName + ".bin").c_str(), "wb");
+        if (binFile == 0)
+        {
+            printf("Error: cannot open %s.bin\n", baseName.c_str());
+            return false;
+        }
+        const char magic[8] = { 'R', 'R', 'L', 'S', 'L', 'O', 'G', '1' };
+        uint32_t dims[2] = { t, p };
+        fwrite(magic, 1, sizeof(magic), binFile);
+        fwrite(dims, sizeof(uint32_t), 2, binFile);
+    }
+    if (csv)
+    {
+        csvFile = fopen((baseName + ".csv").c_str(), "w");
+        if (csvFile == 0)
+        {
+            printf("Error: cannot open %s.csv\n", baseName.c_str());
+            close();
+            return false;
+        }
+        fprintf(csvFile, "sample,time");
+        for (unsigned int i = 0 ; i < t ; ++i)
+            fprintf(csvFile, ",pred%u", i);
+        for (unsigned int i = 0 ; i < t ; ++i)
+            fprintf(csvFile, ",target%u", i);
+        for (unsigned int i = 0 ; i < t ; ++i)
+            fprintf(csvFile, ",error%u", i);
+        for (unsigned int i = 0 ; i < p ; ++i)
+            fprintf(csvFile, ",perf%u", i);
+        fprintf(csvFile, "\n");
+    }
+
+    return start();
+}
+
+/*************************************************************************************************/
+void errorLogger::close()
+{
+    if (isRunning())
+        stop();     // The thread writes the pending records before exiting
+
+    if (binFile != 0)
+    {
+        fclose(binFile);
+        binFile = 0;
+    }
+    if (csvFile != 0)
+    {
+        fclose(csvFile);
+        csvFile = 0;
+    }
+}
+
+/*************************************************************************************************/
+bool errorLogger::push(long unsigned int sample, double time, const double *ypred, const double *y, const double *perf)
+{
+    mutex.lock();
+    if (count == capacity)
+    {
+        ++dropped;
+        mutex.unlock();
+        return false;
+    }
+    unsigned int slot = head;
+    mutex.unlock();
+
+    // The slot is not read by the logger thread until count is incremented
+    double *rec = &ring[slot * width];
+    rec[0] = (double)sample;
+    rec[1] = time;
+    for (unsigned int i = 0 ; i < t ; ++i)
+    {
+        rec[2 + i] = ypred[i];
+        rec[2 + t + i] = y[i];
+        rec[2 + 2*t + i] = y[i] - ypred[i];
+    }
+    for (unsigned int i = 0 ; i < p ; ++i)
+        rec[2 + 3*t + i] = perf[i];
+
+    mutex.lock();
+    head = (head + 1) % capacity;
+    ++count;
+    ++pushed;
+    // Wake the logger when the ring is half full, otherwise it wakes at the next flush period
+    bool wake = (count == capacity / 2 + 1);
+    mutex.unlock();
+
+    if (wake)
+        pending.post();
+    return true;
+}
+
+/*************************************************************************************************/
+void errorLogger::writeCSV(const double *rec)
+{
+    fprintf(csvFile, "%lu,%.6f", (long unsigned int)rec[0], rec[1]);
+    for (unsigned int i = 2 ; i < width ; ++i)
+        fprintf(csvFile, ",%.10g", rec[i]);
+    fprintf(csvFile, "\n");
+}
+
+/*************************************************************************************************/
+void errorLogger::drain()
+{
+    mutex.lock();
+    unsigned int n = count;
+    unsigned int tail = (head + capacity - count) % capacity;
+    mutex.unlock();
+
+    // The records between tail and tail+n are not touched by push() until they are released below
+    for (unsigned int k = 0 ; k < n ; )
+    {
+        unsigned int slot = (tail + k) % capacity;
+        unsigned int run = capacity - slot;     // Contiguous records before the end of the ring
+        if (run > n - k)
+            run = n - k;
+        const double *rec = &ring[slot * width];
+        if (binFile != 0)
+            fwrite(rec, sizeof(double), run * width, binFile);
+        if (csvFile != 0)
+            for (unsigned int r = 0 ; r < run ; ++r)
+                writeCSV(rec + r * width);
+        k += run;
+    }
+
+    mutex.lock();
+    count -= n;
+    written += n;
+    mutex.unlock();
+}
+
+/*************************************************************************************************/
+void errorLogger::run()
+{
+    double lastFlush = Time::now();
+    while (!isStopping())
+    {
+        pending.waitWithTimeout(flushPeriod);
+        drain();
+        if (Time::now() - lastFlush >= flushPeriod)
+        {
+            if (binFile != 0)
+                fflush(binFile);
+            if (csvFile != 0)
+                fflush(csvFile);
+            lastFlush = Time::now();
+        }
+    }
+
+    // Write what is left before the files are closed
+    drain();
+    if (binFile != 0)
+        fflush(binFile);
+    if (csvFile != 0)
+        fflush(csvFile);
+}
+
+/*************************************************************************************************/
+void errorLogger::onStop()
+{
+    pending.post();
+}
+
+/*************************************************************************************************/
+long unsigned int errorLogger::getDropped()
+{
+    mutex.lock();
+    long unsigned int d = dropped;
+    mutex.unlock();
+    return d;
+}
+
+/*************************************************************************************************/
+long unsigned int errorLogger::getWritten()
+{
+    mutex.lock();
+    long unsigned int w = written;
+    mutex.unlock();
+    return w;
+}
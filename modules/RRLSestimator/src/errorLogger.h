@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _ERROR_LOGGER
+#define _ERROR_LOGGER
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+#include <yarp/os/Thread.h>
+#include <yarp/os/Mutex.h>
+#include <yarp/os/Semaphore.h>
+
+/** Asynchronous append-only logger of the per-sample predictions, targets, errors and performance values.
+ *
+ * The estimation loop copies each record in a bounded ring buffer with push(), which never blocks nor
+ * allocates: when the ring is full the record is dropped and counted. A background thread appends the
+ * records to the files and flushes them periodically, so that a crash loses at most the last flush period.
+ *
+ * Each record holds [ sample , time , prediction (t) , target (t) , error (t) , performance (p) ].
+ * The binary file starts with a header (magic "RRLSLOG1", then the uint32 values t and p) followed by the
+ * records as native doubles; the optional CSV file has one line per record, with a header line.
+ */
+class errorLogger : public yarp::os::Thread
+{
+protected:
+    unsigned int            t;          ///< The number of outputs
+    unsigned int            p;          ///< The number of performance values
+    unsigned int            width;      ///< Doubles per record
+    double                  flushPeriod;///< Period of the flushes [s]
+    FILE*                   binFile;    ///< Binary log (0: disabled)
+    FILE*                   csvFile;    ///< CSV log (0: disabled)
+
+    std::vector<double>     ring;       ///< Ring of capacity records
+    unsigned int            capacity;   ///< Records in the ring
+    unsigned int            head;       ///< Next slot written by push()
+    unsigned int            count;      ///< Records waiting to be written
+    yarp::os::Mutex         mutex;      ///< Protects head, count and the statistics
+    yarp::os::Semaphore     pending;    ///< Posted when a batch of records is ready
+
+    long unsigned int       pushed;     ///< Records accepted
+    long unsigned int       written;    ///< Records written to the files
+    long unsigned int       dropped;    ///< Records lost because the ring was full
+
+    /** Write the records waiting in the ring. Called by the logger thread only. */
+    void drain();
+
+    void writeCSV(const double *rec);
+
+public:
+
+    errorLogger();
+    virtual ~errorLogger();
+
+    /** Open the log files and start the logger thread.
+     * @param baseName Path of the files without extension.
+     * @param nOutputs The number of outputs t.
+     * @param nPerf The number of performance values p.
+     * @param binary Write the binary file baseName.bin.
+     * @param csv Write the CSV file baseName.csv.
+     * @param ringSize Capacity of the ring, in records.
+     * @param _flushPeriod Period of the flushes [s].
+     * @return False if a file cannot be opened. */
+    bool open(const std::string &baseName, unsigned int nOutputs, unsigned int nPerf, bool binary, bool csv,
+              unsigned int ringSize, double _flushPeriod);
+
+    /** Stop the logger thread, after writing all the pending records, and close the files. */
+    void close();
+
+    /** Queue a record. Never blocks.
+     * @param sample Index of the sample.
+     * @param time Time stamp of the sample.
+     * @param ypred The prediction (size t).
+     * @param y The target (size t).
+     * @param perf The performance values (size p).
+     * @return False if the record has been dropped. */
+    bool push(long unsigned int sample, double time, const double *ypred, const double *y, const double *perf);
+
+    /** @return True if the log is open. */
+    inline bool isOpen() const { return binFile != 0 || csvFile != 0; }
+
+    /** @return The number of records dropped because the ring was full. */
+    long unsigned int getDropped();
+
+    /** @return The number of records written to the files. */
+    long unsigned int getWritten();
+
+    virtual void run();
+    virtual void onStop();
+};
+
+#endif
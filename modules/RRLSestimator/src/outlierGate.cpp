@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include "outlierGate.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// Floor of the scale, to avoid divisions by zero on noiseless outputs
+static const double minScale = 1e-9;
+
+outlierGate::outlierGate()
+{
+    configure(1, NONE, SKIP, 4.0, 50, 50, 0.01);
+}
+
+/*************************************************************************************************/
+void outlierGate::configure(unsigned int nOutputs, scaleType _scale, actionType _action, double _threshold,
+                            unsigned int _window, unsigned int _warmup, double _forget)
+{
+    t = nOutputs;
+    scale = _scale;
+    action = _action;
+    threshold = _threshold;
+    window = (_window > 0) ? _window : 1;
+    warmup = _warmup;
+    forget = _forget;
+
+    // E[psi_k(Z)^2] = 2 Phi(k) - 1 - 2 k phi(k) + 2 k^2 (1 - Phi(k))
+    const double k = threshold;
+    const double Phi = 0.5 * (1.0 + erf(k / sqrt(2.0)));
+    const double phi = exp(-0.5 * k * k) / sqrt(2.0 * M_PI);
+    kappa = 2.0 * Phi - 1.0 - 2.0 * k * phi + 2.0 * k * k * (1.0 - Phi);
+
+    absErr.assign(scale == MAD ? t * window : 0, 0.0);
+    work.assign(scale == MAD ? window : 0, 0.0);
+    s.assign(t, minScale);
+    s2.assign(t, 0.0);
+    head = 0;
+    observed = 0;
+    rejected = 0;
+    downweighted = 0;
+}
+
+/*************************************************************************************************/
+bool outlierGate::parseScale(const string &name, scaleType &type)
+{
+    if (name == "none")         type = NONE;
+    else if (name == "mad")     type = MAD;
+    else if (name == "huber")   type = HUBER;
+    else                        return false;
+    return true;
+}
+
+/*************************************************************************************************/
+bool outlierGate::parseAction(const string &name, actionType &type)
+{
+    if (name == "skip")             type = SKIP;
+    else if (name == "downweight")  type = DOWNWEIGHT;
+    else                            return false;
+    return true;
+}
+
+/*************************************************************************************************/
+void outlierGate::updateMAD(unsigned int c)
+{
+    const unsigned int n = (observed < window) ? (unsigned int)observed : window;
+    const double *ring = &absErr[c * window];
+    for (unsigned int i = 0 ; i < n ; ++i)
+        work[i] = ring[i];
+    nth_element(work.begin(), work.begin() + n/2, work.begin() + n);
+    const double mad = 1.4826 * work[n/2];
+    s[c] = (mad > minScale) ? mad : minScale;
+}
+
+/*************************************************************************************************/
+double outlierGate::evaluate(const double *e)
+{
+    if (scale == NONE)
+        return 1.0;
+
+    // Normalized residual, against the scale before this sample
+    double r = 0.0;
+    for (unsigned int c = 0 ; c < t ; ++c)
+    {
+        const double rc = fabs(e[c]) / s[c];
+        if (rc > r)
+            r = rc;
+    }
+    const bool gating = observed >= warmup;
+
+    // Update the scale estimates
+    ++observed;
+    if (scale == MAD)
+    {
+        for (unsigned int c = 0 ; c < t ; ++c)
+        {
+            absErr[c * window + head] = fabs(e[c]);
+            updateMAD(c);
+        }
+        head = (head + 1) % window;
+    }
+    else
+    {
+        for (unsigned int c = 0 ; c < t ; ++c)
+        {
+            const double e2 = e[c] * e[c];
+            if (observed <= warmup || s2[c] <= 0.0)
+                s2[c] += (e2 - s2[c]) / observed;      // Plain mean of the squares during the warm-up
+            else
+            {
+                const double clip2 = threshold * threshold * s2[c];
+                s2[c] += forget * (((e2 < clip2) ? e2 : clip2) / kappa - s2[c]);
+            }
+            const double sc = sqrt(s2[c]);
+            s[c] = (sc > minScale) ? sc : minScale;
+        }
+    }
+
+    if (!gating || r <= threshold)
+        return 1.0;
+    if (action == SKIP)
+    {
+        ++rejected;
+        return 0.0;
+    }
+    ++downweighted;
+    return threshold / r;
+}
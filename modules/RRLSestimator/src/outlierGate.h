@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _OUTLIER_GATE
+#define _OUTLIER_GATE
+
+#include <vector>
+#include <string>
+
+/** Gating stage which decides, from the a-priori residual \f$ e = y - W^T x \f$, whether a sample
+ * should be absorbed by the recursive model.
+ *
+ * Each output keeps a running robust estimate \f$ s_c \f$ of the scale of its residuals, and the sample
+ * is scored as \f$ r = \max_c |e_c| / s_c \f$. Samples with \f$ r \f$ above the threshold \f$ k \f$ are
+ * either skipped (weight 0) or down-weighted with the Huber weight \f$ k / r \f$. A weight \f$ w \f$ is
+ * applied by absorbing \f$ (\sqrt{w} x, \sqrt{w} y) \f$, i.e. a weighted least squares term.
+ *
+ * Two scale estimators are available:
+ * - MAD: \f$ 1.4826 \cdot \mathrm{median}(|e_c|) \f$ over a window of recent residuals, \f$ O(window) \f$
+ *   per output and sample;
+ * - Huber: exponentially weighted scale with the residuals clipped at \f$ k s_c \f$ (Huber's proposal 2),
+ *   \f$ O(1) \f$ per output and sample.
+ *
+ * All the residuals, including the rejected ones, update the scale, so that the gate follows genuine changes
+ * of the noise level. No gating is done during the warm-up. The buffers are allocated by configure().
+ */
+class outlierGate
+{
+public:
+    enum scaleType  { NONE, MAD, HUBER };
+    enum actionType { SKIP, DOWNWEIGHT };
+
+protected:
+    unsigned int            t;          ///< The number of outputs
+    scaleType               scale;      ///< Robust scale estimator
+    actionType              action;     ///< Action on the outliers
+    double                  threshold;  ///< Threshold k on the normalized residual
+    unsigned int            window;     ///< Length of the MAD window
+    unsigned int            warmup;     ///< Samples observed before gating starts
+    double                  forget;     ///< Forgetting factor of the Huber scale
+    double                  kappa;      ///< Consistency factor of the Huber scale, E[psi_k(Z)^2] for Z ~ N(0,1)
+    std::vector<double>     absErr;     ///< MAD: ring of the last window absolute residuals (t x window)
+    std::vector<double>     work;       ///< MAD: workspace of the median
+    std::vector<double>     s;          ///< Current scale of each output
+    std::vector<double>     s2;         ///< Huber: current squared scale of each output
+    unsigned int            head;       ///< MAD: next slot of the ring
+    long unsigned int       observed;   ///< Observed residuals
+    long unsigned int       rejected;   ///< Skipped samples
+    long unsigned int       downweighted;   ///< Down-weighted samples
+
+    /** Recompute the scale of output c from its MAD window. */
+    void updateMAD(unsigned int c);
+
+public:
+
+    outlierGate();
+
+    /** Configure the gate and allocate its buffers.
+     * @param nOutputs The number of outputs t.
+     * @param _scale The robust scale estimator (NONE disables the gate).
+     * @param _action The action on the outliers.
+     * @param _threshold The threshold k on the normalized residual.
+     * @param _window The length of the MAD window.
+     * @param _warmup The number of samples observed before gating starts.
+     * @param _forget The forgetting factor of the Huber scale, in (0,1]. */
+    void configure(unsigned int nOutputs, scaleType _scale, actionType _action, double _threshold,
+                   unsigned int _window, unsigned int _warmup, double _forget);
+
+    /** Evaluate a sample and update the scale estimates with its residual.
+     * @param e The a-priori residual (size t).
+     * @return The weight of the sample: 1 to absorb it, 0 to skip it, in between to down-weight it. */
+    double evaluate(const double *e);
+
+    static bool parseScale(const std::string &name, scaleType &type);
+    static bool parseAction(const std::string &name, actionType &type);
+
+    /** @return True if the gate is enabled. */
+    inline bool isEnabled() const { return scale != NONE; }
+
+    /** @return The current scale of output c. */
+    inline double getScale(unsigned int c) const { return s[c]; }
+
+    /** @return The number of skipped samples. */
+    inline long unsigned int getRejected() const { return rejected; }
+
+    /** @return The number of down-weighted samples. */
+    inline long unsigned int getDownweighted() const { return downweighted; }
+};
+
+#endif
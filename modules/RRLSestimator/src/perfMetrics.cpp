@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include "perfMetrics.h"
+#include <cmath>
+
+using namespace std;
+
+perfMetrics::perfMetrics()
+{
+    vector<measure> m(1);
+    m[0].type = RMSE;
+    m[0].horizon = CUMULATIVE;
+    configure(1, m, vector<vector<unsigned int> >(), 100, 0.01);
+}
+
+/*************************************************************************************************/
+bool perfMetrics::configure(unsigned int nOutputs, const vector<measure> &_measures,
+                            const vector<vector<unsigned int> > &groups, unsigned int _window, double _forget,
+                            bool _trackTrend)
+{
+    t = nOutputs;
+    measures = _measures;
+    window = (_window > 0) ? _window : 1;
+    forget = _forget;
+    trackTrend = _trackTrend;
+
+    groupIdx.clear();
+    groupStart.clear();
+    if (!groups.empty())
+    {
+        for (size_t g = 0 ; g < groups.size() ; ++g)
+        {
+            if (groups[g].empty())
+                return false;
+            groupStart.push_back(groupIdx.size());
+            for (size_t i = 0 ; i < groups[g].size() ; ++i)
+            {
+                if (groups[g][i] >= t)
+                    return false;
+                groupIdx.push_back(groups[g][i]);
+            }
+        }
+        groupStart.push_back(groupIdx.size());
+    }
+
+    // Only the accumulators required by the measures are maintained
+    for (int h = 0 ; h < 3 ; ++h)
+        useAbs[h] = useSq[h] = false;
+    for (size_t k = 0 ; k < measures.size() ; ++k)
+    {
+        if (measures[k].type == MAE)
+            useAbs[measures[k].horizon] = true;
+        else
+            useSq[measures[k].horizon] = true;
+    }
+    if (trackTrend)
+        useSq[CUMULATIVE] = useSq[WINDOW] = true;
+
+    fixedVar = false;
+    var.assign(t, 1.0);
+    perOutput.assign(t, 0.0);
+    reset();
+    return true;
+}
+
+/*************************************************************************************************/
+void perfMetrics::reset()
+{
+    count = 0;
+    for (int h = 0 ; h < 3 ; ++h)
+    {
+        sq[h].assign(t, 0.0);
+        ab[h].assign(t, 0.0);
+    }
+    ringSq.assign(useSq[WINDOW] ? window * t : 0, 0.0);
+    ringAbs.assign(useAbs[WINDOW] ? window * t : 0, 0.0);
+    sumSq.assign(t, 0.0);
+    sumAbs.assign(t, 0.0);
+    ringHead = 0;
+    ringCount = 0;
+    decayNorm = 0.0;
+    yMean.assign(t, 0.0);
+    yM2.assign(t, 0.0);
+}
+
+/*************************************************************************************************/
+void perfMetrics::setVariance(const double *v)
+{
+    for (unsigned int c = 0 ; c < t ; ++c)
+        var[c] = v[c];
+    fixedVar = true;
+}
+
+/*************************************************************************************************/
+bool perfMetrics::parseMeasure(const string &name, measure &m)
+{
+    string type = name;
+    string horizon = "cumulative";
+    size_t sep = name.find(':');
+    if (sep != string::npos)
+    {
+        type = name.substr(0, sep);
+        horizon = name.substr(sep + 1);
+    }
+
+    if (type == "MSE")          m.type = MSE;
+    else if (type == "RMSE")    m.type = RMSE;
+    else if (type == "nMSE")    m.type = NMSE;
+    else if (type == "MAE")     m.type = MAE;
+    else                        return false;
+
+    if (horizon == "cumulative")    m.horizon = CUMULATIVE;
+    else if (horizon == "window")   m.horizon = WINDOW;
+    else if (horizon == "decay")    m.horizon = DECAY;
+    else                            return false;
+    return true;
+}
+
+/*************************************************************************************************/
+void perfMetrics::update(const double *y, const double *ypred)
+{
+    ++count;
+    const double invCount = 1.0 / count;
+    decayNorm += forget * (1.0 - decayNorm);
+    if (ringCount < window)
+        ++ringCount;
+    double *rSq = useSq[WINDOW] ? &ringSq[ringHead * t] : 0;
+    double *rAbs = useAbs[WINDOW] ? &ringAbs[ringHead * t] : 0;
+
+    for (unsigned int c = 0 ; c < t ; ++c)
+    {
+        const double e = y[c] - ypred[c];
+        const double e2 = e * e;
+        const double ea = fabs(e);
+
+        // Running means, without rescaling the previous value
+        if (useSq[CUMULATIVE])
+            sq[CUMULATIVE][c] += (e2 - sq[CUMULATIVE][c]) * invCount;
+        if (useAbs[CUMULATIVE])
+            ab[CUMULATIVE][c] += (ea - ab[CUMULATIVE][c]) * invCount;
+
+        // Window: the new error replaces the oldest one in the running sums
+        if (rSq != 0)
+        {
+            sumSq[c] += e2 - rSq[c];
+            rSq[c] = e2;
+        }
+        if (rAbs != 0)
+        {
+            sumAbs[c] += ea - rAbs[c];
+            rAbs[c] = ea;
+        }
+
+        if (useSq[DECAY])
+            sq[DECAY][c] += forget * (e2 - sq[DECAY][c]);
+        if (useAbs[DECAY])
+            ab[DECAY][c] += forget * (ea - ab[DECAY][c]);
+
+        // Welford update of the target variance
+        if (!fixedVar)
+        {
+            const double delta = y[c] - yMean[c];
+            yMean[c] += delta * invCount;
+            yM2[c] += delta * (y[c] - yMean[c]);
+        }
+    }
+    ringHead = (ringHead + 1) % window;
+    if (ringHead == 0)
+        resync();
+}
+
+/*************************************************************************************************/
+void perfMetrics::resync()
+{
+    for (unsigned int c = 0 ; c < t ; ++c)
+    {
+        sumSq[c] = 0.0;
+        sumAbs[c] = 0.0;
+    }
+    for (unsigned int k = 0 ; k < ringCount ; ++k)
+    {
+        if (useSq[WINDOW])
+            for (unsigned int c = 0 ; c < t ; ++c)
+                sumSq[c] += ringSq[k * t + c];
+        if (useAbs[WINDOW])
+            for (unsigned int c = 0 ; c < t ; ++c)
+                sumAbs[c] += ringAbs[k * t + c];
+    }
+}
+
+/*************************************************************************************************/
+double perfMetrics::getTrend() const
+{
+    if (!trackTrend || ringCount < window)
+        return 0.0;
+    double trend = 0.0;
+    for (unsigned int c = 0 ; c < t ; ++c)
+    {
+        const double cum = sq[CUMULATIVE][c];
+        if (cum > 0.0 && sumSq[c] / window / cum > trend)
+            trend = sumSq[c] / window / cum;
+    }
+    return trend;
+}
+
+/*************************************************************************************************/
+double perfMetrics::value(const measure &m, unsigned int c) const
+{
+    double mean;
+    if (m.horizon == WINDOW)
+    {
+        const double s = (m.type == MAE) ? sumAbs[c] : sumSq[c];
+        mean = (ringCount > 0 && s > 0.0) ? s / ringCount : 0.0;
+    }
+    else if (m.horizon == DECAY)
+    {
+        const double s = (m.type == MAE) ? ab[DECAY][c] : sq[DECAY][c];
+        mean = (decayNorm > 0.0) ? s / decayNorm : 0.0;
+    }
+    else
+        mean = (m.type == MAE) ? ab[CUMULATIVE][c] : sq[CUMULATIVE][c];
+
+    switch (m.type)
+    {
+    case RMSE:
+        return sqrt(mean);
+    case NMSE:
+    {
+        const double v = fixedVar ? var[c] : ((count > 1) ? yM2[c] / count : 0.0);
+        return (v > 0.0) ? mean / v : 0.0;
+    }
+    default:
+        return mean;
+    }
+}
+
+/*************************************************************************************************/
+void perfMetrics::evaluate(double *out)
+{
+    size_t o = 0;
+    for (size_t k = 0 ; k < measures.size() ; ++k)
+    {
+        for (unsigned int c = 0 ; c < t ; ++c)
+            perOutput[c] = value(measures[k], c);
+
+        if (groupStart.empty())
+        {
+            for (unsigned int c = 0 ; c < t ; ++c)
+                out[o++] = perOutput[c];
+        }
+        else
+        {
+            for (size_t g = 0 ; g + 1 < groupStart.size() ; ++g)
+            {
+                double acc = 0.0;
+                for (unsigned int i = groupStart[g] ; i < groupStart[g+1] ; ++i)
+                    acc += perOutput[groupIdx[i]];
+                out[o++] = acc / (groupStart[g+1] - groupStart[g]);
+            }
+        }
+    }
+}
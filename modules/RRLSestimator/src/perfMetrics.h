@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _PERF_METRICS
+#define _PERF_METRICS
+
+#include <vector>
+#include <string>
+
+/** Incremental performance metrics of a multi-output predictor.
+ *
+ * Each measure is one of MSE, RMSE, nMSE (MSE divided by the variance of the target) and MAE,
+ * computed over one of three horizons:
+ * - cumulative: all the samples since the start, as a running mean;
+ * - window: the last N samples, with a ring buffer and running sums;
+ * - decay: exponentially weighted with forgetting factor \f$ \lambda \f$, bias corrected so that
+ *   the first samples are not underestimated.
+ *
+ * The measures are named as "RMSE", "RMSE:window", "nMSE:decay", ... Every measure is published
+ * either per output, or averaged over each group of outputs (e.g. forces and torques).
+ *
+ * update() makes a single pass over the residual vector, in \f$ O(t) \f$, and only maintains the
+ * accumulators needed by the configured measures. Nothing is allocated after configure(). The running
+ * sums of the window are recomputed from the ring each time it wraps around, in \f$ O(t) \f$ amortized,
+ * so that rounding errors do not accumulate over long runs.
+ *
+ * Optionally, the trend of the error is tracked as the ratio between the windowed and the cumulative
+ * MSE: a ratio well above 1 reveals a degradation of the model long before the cumulative measures move.
+ */
+class perfMetrics
+{
+public:
+    enum measureType { MSE, RMSE, NMSE, MAE };
+    enum horizonType { CUMULATIVE, WINDOW, DECAY };
+
+    /** A published measure. */
+    struct measure
+    {
+        measureType type;
+        horizonType horizon;
+    };
+
+protected:
+    unsigned int                t;          ///< The number of outputs
+    std::vector<measure>        measures;   ///< Published measures
+    std::vector<unsigned int>   groupIdx;   ///< Outputs of all the groups, concatenated
+    std::vector<unsigned int>   groupStart; ///< Start of each group in groupIdx (size: groups + 1)
+    unsigned int                window;     ///< Length of the window
+    double                      forget;     ///< Forgetting factor of the decayed measures
+    bool                        useAbs[3];  ///< Absolute errors needed, per horizon
+    bool                        useSq[3];   ///< Squared errors needed, per horizon
+    bool                        trackTrend; ///< Track the ratio of the windowed and cumulative MSE
+
+    long unsigned int           count;      ///< Samples seen
+    std::vector<double>         sq[3];      ///< Mean squared error of each output, per horizon
+    std::vector<double>         ab[3];      ///< Mean absolute error of each output, per horizon
+    std::vector<double>         ringSq;     ///< Window: last squared errors (window x t)
+    std::vector<double>         ringAbs;    ///< Window: last absolute errors (window x t)
+    std::vector<double>         sumSq;      ///< Window: running sums of the squared errors
+    std::vector<double>         sumAbs;     ///< Window: running sums of the absolute errors
+    unsigned int                ringHead;   ///< Window: next slot of the ring
+    unsigned int                ringCount;  ///< Window: samples in the ring
+    double                      decayNorm;  ///< Decay: total weight, for the bias correction
+
+    bool                        fixedVar;   ///< The target variance was given with setVariance()
+    std::vector<double>         var;        ///< Variance of the targets, for nMSE
+    std::vector<double>         yMean;      ///< Running mean of the targets
+    std::vector<double>         yM2;        ///< Running sum of the squared deviations of the targets
+
+    std::vector<double>         perOutput;  ///< Workspace: value of a measure for each output
+
+    /** Value of measure m for output c. */
+    double value(const measure &m, unsigned int c) const;
+
+    /** Recompute the running sums of the window from the ring. */
+    void resync();
+
+public:
+
+    perfMetrics();
+
+    /** Configure the metrics and allocate the accumulators.
+     * @param nOutputs The number of outputs t.
+     * @param _measures The published measures.
+     * @param groups The groups of outputs; if empty, each measure is published per output.
+     * @param _window The length of the window.
+     * @param _forget The forgetting factor of the decayed measures, in (0,1].
+     * @param _trackTrend Track the ratio of the windowed and cumulative MSE (see getTrend()).
+     * @return False if a group contains an invalid output index. */
+    bool configure(unsigned int nOutputs, const std::vector<measure> &_measures,
+                   const std::vector<std::vector<unsigned int> > &groups, unsigned int _window, double _forget,
+                   bool _trackTrend = false);
+
+    /** Reset the accumulators, keeping the configuration and the target variance given with setVariance(). */
+    void reset();
+
+    /** Set the variance of the targets used by nMSE, e.g. estimated on the training set.
+     * Otherwise, the running variance of the received targets is used.
+     * @param v Variance of each output (size t). */
+    void setVariance(const double *v);
+
+    /** Absorb a new prediction.
+     * @param y The target (size t).
+     * @param ypred The prediction (size t). */
+    void update(const double *y, const double *ypred);
+
+    /** Compute the published values: for each measure, one value per group (or per output).
+     * @param out The values (size getSize()). */
+    void evaluate(double *out);
+
+    /** Parse a measure name such as "RMSE" or "nMSE:window".
+     * @return False if the name is not valid. */
+    static bool parseMeasure(const std::string &name, measure &m);
+
+    /** @return The largest ratio, over the outputs, between the MSE of the last window and the cumulative
+     * MSE, or 0 until the window is full or if the trend is not tracked. */
+    double getTrend() const;
+
+    /** @return The number of published values. */
+    inline unsigned int getSize() const
+    {
+        return measures.size() * (groupStart.empty() ? t : groupStart.size() - 1);
+    }
+
+    /** @return The number of samples seen. */
+    inline long unsigned int getCount() const { return count; }
+};
+
+#endif
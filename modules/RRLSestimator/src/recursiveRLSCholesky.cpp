@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include "recursiveRLSCholesky.h"
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+recursiveRLSCholesky::recursiveRLSCholesky(unsigned int nFeatures, unsigned int nOutputs, double reg)
+{
+    reset(nFeatures, nOutputs, reg);
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::reset(unsigned int nFeatures, unsigned int nOutputs, double reg)
+{
+    d = nFeatures;
+    t = nOutputs;
+    lambda = reg;
+    sampleCount = 0;
+
+    R.assign(d*d, 0.0);
+    for (unsigned int i = 0 ; i < d ; ++i)
+        R[i*d + i] = sqrt(lambda);
+    B.assign(d*t, 0.0);
+    W.assign(d*t, 0.0);
+    z.assign(d, 0.0);
+    k.assign(d, 0.0);
+    e.assign(t, 0.0);
+    rc.assign(d, 0.0);
+    rs.assign(d, 0.0);
+}
+
+/*************************************************************************************************/
+bool recursiveRLSCholesky::factorize()
+{
+    // In-place right-looking Cholesky factorization A = R^T R
+    for (unsigned int p = 0 ; p < d ; ++p)
+    {
+        double *Rp = &R[p*d];
+        if (Rp[p] <= 0.0)
+        {
+            printf("Error: matrix not positive definite at pivot %u\n", p);
+            return false;
+        }
+        const double piv = sqrt(Rp[p]);
+        for (unsigned int j = p ; j < d ; ++j)
+            Rp[j] /= piv;
+        for (unsigned int i = p+1 ; i < d ; ++i)
+        {
+            double *Ri = &R[i*d];
+            const double rpi = Rp[i];
+            for (unsigned int j = i ; j < d ; ++j)
+                Ri[j] -= rpi * Rp[j];
+        }
+    }
+    return true;
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::solveWeights()
+{
+    // W = R^-1 R^-T B, solved for all the t right-hand sides at once
+    W = B;
+    for (unsigned int p = 0 ; p < d ; ++p)
+    {
+        const double *Rp = &R[p*d];
+        double *Wp = &W[p*t];
+        for (unsigned int c = 0 ; c < t ; ++c)
+            Wp[c] /= Rp[p];
+        for (unsigned int j = p+1 ; j < d ; ++j)
+            for (unsigned int c = 0 ; c < t ; ++c)
+                W[j*t + c] -= Rp[j] * Wp[c];
+    }
+    for (int i = d-1 ; i >= 0 ; --i)
+    {
+        const double *Ri = &R[i*d];
+        double *Wi = &W[i*t];
+        for (unsigned int j = i+1 ; j < d ; ++j)
+            for (unsigned int c = 0 ; c < t ; ++c)
+                Wi[c] -= Ri[j] * W[j*t + c];
+        for (unsigned int c = 0 ; c < t ; ++c)
+            Wi[c] /= Ri[i];
+    }
+}
+
+/*************************************************************************************************/
+bool recursiveRLSCholesky::train(const double *X, const double *Y, long unsigned int n)
+{
+    // Upper triangle of A = X^T X + lambda I, accumulated in R
+    R.assign(d*d, 0.0);
+    for (unsigned int i = 0 ; i < d ; ++i)
+        R[i*d + i] = lambda;
+    for (long unsigned int s = 0 ; s < n ; ++s)
+    {
+        const double *x = X + s*d;
+        for (unsigned int i = 0 ; i < d ; ++i)
+        {
+            double *Ri = &R[i*d];
+            const double xi = x[i];
+            for (unsigned int j = i ; j < d ; ++j)
+                Ri[j] += xi * x[j];
+        }
+    }
+    if (!factorize())
+        return false;
+
+    // B = X^T Y
+    B.assign(d*t, 0.0);
+    for (long unsigned int s = 0 ; s < n ; ++s)
+    {
+        const double *x = X + s*d;
+        const double *y = Y + s*t;
+        for (unsigned int i = 0 ; i < d ; ++i)
+            for (unsigned int c = 0 ; c < t ; ++c)
+                B[i*t + c] += x[i] * y[c];
+    }
+
+    solveWeights();
+    sampleCount = n;
+    return true;
+}
+
+/*************************************************************************************************/
+bool recursiveRLSCholesky::trainHoldOut(const double *X, const double *Y, long unsigned int n, double holdOut, int nLambda)
+{
+    long unsigned int nVal = (long unsigned int)(holdOut * n + 0.5);
+    if (holdOut <= 0.0 || nLambda < 1 || nVal < 1 || nVal >= n)
+        return train(X, Y, n);
+    const long unsigned int nTr = n - nVal;
+
+    // Gram matrix (upper triangle) and right-hand side of the training part, shared by all the candidates
+    vector<double> G(d*d, 0.0);
+    B.assign(d*t, 0.0);
+    for (long unsigned int s = 0 ; s < nTr ; ++s)
+    {
+        const double *x = X + s*d;
+        const double *y = Y + s*t;
+        for (unsigned int i = 0 ; i < d ; ++i)
+        {
+            double *Gi = &G[i*d];
+            const double xi = x[i];
+            for (unsigned int j = i ; j < d ; ++j)
+                Gi[j] += xi * x[j];
+            for (unsigned int c = 0 ; c < t ; ++c)
+                B[i*t + c] += xi * y[c];
+        }
+    }
+    double trace = 0.0;
+    for (unsigned int i = 0 ; i < d ; ++i)
+        trace += G[i*d + i];
+    if (trace <= 0.0)
+        return train(X, Y, n);
+
+    // Geometric grid, as the eigenvalue-based guesses of GURLS with tr(X^T X) bounding the largest eigenvalue
+    const double lmax = trace;
+    const double lmin = 200.0 * sqrt(2.2204460492503131e-16) * lmax;
+    double bestLambda = -1.0;
+    double bestErr = 0.0;
+    for (int q = 0 ; q < nLambda ; ++q)
+    {
+        const double reg = (nLambda > 1) ? lmin * pow(lmax / lmin, (double)q / (nLambda - 1)) : lmax;
+        R = G;
+        for (unsigned int i = 0 ; i < d ; ++i)
+            R[i*d + i] += reg;
+        if (!factorize())
+            continue;
+        solveWeights();
+
+        double err = 0.0;
+        for (long unsigned int s = nTr ; s < n ; ++s)
+        {
+            predict(X + s*d, &e[0]);
+            for (unsigned int c = 0 ; c < t ; ++c)
+            {
+                const double r = Y[s*t + c] - e[c];
+                err += r*r;
+            }
+        }
+        err = sqrt(err / (nVal * t));
+        if (bestLambda < 0.0 || err < bestErr)
+        {
+            bestLambda = reg;
+            bestErr = err;
+        }
+    }
+    if (bestLambda < 0.0)
+    {
+        printf("Error: no value of lambda gives a positive definite matrix\n");
+        return false;
+    }
+
+    printf("Hold-out selection: lambda = %g (validation RMSE %g on %lu samples)\n", bestLambda, bestErr, nVal);
+    lambda = bestLambda;
+    return train(X, Y, n);
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::solveLowerInPlace(const double *x) const
+{
+    for (unsigned int i = 0 ; i < d ; ++i)
+        z[i] = x[i];
+    for (unsigned int p = 0 ; p < d ; ++p)
+    {
+        const double *Rp = &R[p*d];
+        const double zp = (z[p] /= Rp[p]);
+        for (unsigned int j = p+1 ; j < d ; ++j)
+            z[j] -= Rp[j] * zp;
+    }
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::solveUpperInPlace(double *v) const
+{
+    for (int i = d-1 ; i >= 0 ; --i)
+    {
+        const double *Ri = &R[i*d];
+        double acc = v[i];
+        for (unsigned int j = i+1 ; j < d ; ++j)
+            acc -= Ri[j] * v[j];
+        v[i] = acc / Ri[i];
+    }
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::update(const double *x, const double *y)
+{
+    // A-priori residual e = y - W^T x
+    predict(x, &e[0]);
+    for (unsigned int c = 0 ; c < t ; ++c)
+        e[c] = y[c] - e[c];
+
+    // Rank-1 update of the upper Cholesky factor: R^T R <- R^T R + x x^T.
+    // The Givens rotations applied to the rows of [R ; x^T] also map the unit vector
+    // e_{d+1} to [R'^-T x ; *], so z = R'^-T x comes out of the same pass in O(d).
+    for (unsigned int i = 0 ; i < d ; ++i)
+        k[i] = x[i];
+    double cprod = 1.0;
+    for (unsigned int p = 0 ; p < d ; ++p)
+    {
+        double *Rp = &R[p*d];
+        const double r = sqrt(Rp[p]*Rp[p] + k[p]*k[p]);
+        const double c = r / Rp[p];
+        const double s = k[p] / Rp[p];
+        const double invc = 1.0 / c;
+        z[p] = cprod * k[p] / r;
+        cprod *= invc;
+        Rp[p] = r;
+        for (unsigned int j = p+1 ; j < d ; ++j)
+        {
+            Rp[j] = (Rp[j] + s*k[j]) * invc;
+            k[j] = c*k[j] - s*Rp[j];
+        }
+    }
+
+    // Gain k = A^-1 x = R'^-1 z, with a single backward substitution
+    for (unsigned int i = 0 ; i < d ; ++i)
+        k[i] = z[i];
+    solveUpperInPlace(&k[0]);
+
+    // B <- B + x y^T and W <- W + k e^T
+    for (unsigned int i = 0 ; i < d ; ++i)
+    {
+        double *Bi = &B[i*t];
+        double *Wi = &W[i*t];
+        for (unsigned int c = 0 ; c < t ; ++c)
+        {
+            Bi[c] += x[i] * y[c];
+            Wi[c] += k[i] * e[c];
+        }
+    }
+
+    ++sampleCount;
+}
+
+/*************************************************************************************************/
+bool recursiveRLSCholesky::downdate(const double *x, const double *y)
+{
+    // z = R^-T x. The downdated matrix is positive definite iff ||z|| < 1.
+    solveLowerInPlace(x);
+    double norm2 = 0.0;
+    for (unsigned int i = 0 ; i < d ; ++i)
+        norm2 += z[i]*z[i];
+    if (norm2 >= 1.0 - 1e-12)
+    {
+        printf("Error: downdate would make the matrix not positive definite\n");
+        return false;
+    }
+
+    // A-priori residual e = y - W^T x, with the weights before the downdate
+    predict(x, &e[0]);
+    for (unsigned int c = 0 ; c < t ; ++c)
+        e[c] = y[c] - e[c];
+
+    // Rotations which annihilate z against sqrt(1 - ||z||^2), from the last element to the first
+    double alpha = sqrt(1.0 - norm2);
+    for (int i = d-1 ; i >= 0 ; --i)
+    {
+        const double scale = alpha + fabs(z[i]);
+        const double a = alpha / scale;
+        const double b = z[i] / scale;
+        const double nrm = sqrt(a*a + b*b);
+        rc[i] = a / nrm;
+        rs[i] = b / nrm;
+        alpha = scale * nrm;
+    }
+
+    // Apply them to each column of R: R^T R <- R^T R - x x^T
+    for (unsigned int j = 0 ; j < d ; ++j)
+    {
+        double acc = 0.0;
+        for (int i = j ; i >= 0 ; --i)
+        {
+            double &Rij = R[i*d + j];
+            const double tmp = rc[i]*acc + rs[i]*Rij;
+            Rij = rc[i]*Rij - rs[i]*acc;
+            acc = tmp;
+        }
+    }
+
+    // Gain k = A^-1 x with the downdated factor
+    solveLowerInPlace(x);
+    for (unsigned int i = 0 ; i < d ; ++i)
+        k[i] = z[i];
+    solveUpperInPlace(&k[0]);
+
+    // B <- B - x y^T and W <- W - k e^T
+    for (unsigned int i = 0 ; i < d ; ++i)
+    {
+        double *Bi = &B[i*t];
+        double *Wi = &W[i*t];
+        for (unsigned int c = 0 ; c < t ; ++c)
+        {
+            Bi[c] -= x[i] * y[c];
+            Wi[c] -= k[i] * e[c];
+        }
+    }
+
+    if (sampleCount > 0)
+        --sampleCount;
+    return true;
+}
+
+/*************************************************************************************************/
+void recursiveRLSCholesky::predict(const double *x, double *y) const
+{
+    for (unsigned int c = 0 ; c < t ; ++c)
+        y[c] = 0.0;
+    for (unsigned int i = 0 ; i < d ; ++i)
+    {
+        const double *Wi = &W[i*t];
+        for (unsigned int c = 0 ; c < t ; ++c)
+            y[c] += Wi[c] * x[i];
+    }
+}
+
+/*************************************************************************************************/
+double recursiveRLSCholesky::predictiveVariance(const double *x) const
+{
+    // x^T A^-1 x = ||R^-T x||^2
+    solveLowerInPlace(x);
+    double var = 0.0;
+    for (unsigned int i = 0 ; i < d ; ++i)
+        var += z[i]*z[i];
+    return var;
+}
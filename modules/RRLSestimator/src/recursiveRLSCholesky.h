@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _RECURSIVE_RLS_CHOLESKY
+#define _RECURSIVE_RLS_CHOLESKY
+
+#include <vector>
+
+/** Class for performing recursive regularized least squares (RRLS) estimation
+ * of a multi-output linear model of the form:
+ * \f[
+ * y = W^T x,
+ * \f]
+ * where \f$ x \in R^d \f$ is the feature vector, \f$ y \in R^t \f$ is the output vector
+ * and \f$ W \in R^{d \times t} \f$ is the weight matrix. After \f$ n \f$ samples
+ * (\f$ X_n, Y_n \f$) the weights are:
+ * \f[
+ * W_n = (\underbrace{X_n^T X_n + \lambda I}_{A_n})^{-1} \underbrace{X_n^T Y_n}_{B_n}
+ * \f]
+ * All the outputs share the same features, hence they share a single upper triangular
+ * Cholesky factor \f$ R_n \f$ such that \f$ A_n = R_n^T R_n \f$. Each new sample is
+ * absorbed with one rank-1 update of \f$ R \f$ and the weights are corrected as
+ * \f[
+ * W_{n+1} = W_n + A_{n+1}^{-1} x (y - W_n^T x)^T,
+ * \f]
+ * which costs \f$ O(d^2 + dt) \f$ per sample: exactly one rank-1 update of \f$ R \f$
+ * (which also yields \f$ R_{n+1}^{-T} x \f$) and one backward substitution, shared by all
+ * the t outputs. No per-output triangular solve is performed.
+ *
+ * All matrices are stored row-major in contiguous buffers. The workspaces are
+ * allocated once, so neither the update nor the prediction allocate memory.
+ */
+class recursiveRLSCholesky
+{
+protected:
+    unsigned int                d;      ///< The number of features
+    unsigned int                t;      ///< The number of outputs
+    double                 lambda;      ///< Regularization parameter
+    std::vector<double>         R;      ///< Upper triangular Cholesky factor of A (d x d)
+    std::vector<double>         B;      ///< Right-hand side X^T Y (d x t)
+    std::vector<double>         W;      ///< Current weights (d x t)
+    mutable std::vector<double> z;      ///< Workspace: solution of R^T z = x
+    std::vector<double>         k;      ///< Workspace: gain vector A^-1 x
+    std::vector<double>         e;      ///< Workspace: a-priori residual
+    std::vector<double>         rc;     ///< Workspace: cosines of the downdate rotations
+    std::vector<double>         rs;     ///< Workspace: sines of the downdate rotations
+    long unsigned int   sampleCount;    ///< Number of samples absorbed by the model
+
+    /** Solve \f$ R^T z = x \f$ (forward substitution) into the workspace z. */
+    void solveLowerInPlace(const double *x) const;
+
+    /** Solve \f$ R v = v \f$ (backward substitution) in place. */
+    void solveUpperInPlace(double *v) const;
+
+    /** In-place Cholesky factorization of the upper triangle of A, stored in R.
+     * @return False if A is not positive definite. */
+    bool factorize();
+
+    /** Solve \f$ R^T R W = B \f$ for all the t right-hand sides at once. */
+    void solveWeights();
+
+public:
+
+    /** Constructor.
+     * @param nFeatures The number of features d.
+     * @param nOutputs The number of outputs t.
+     * @param reg The regularization parameter lambda. */
+    recursiveRLSCholesky(unsigned int nFeatures = 1, unsigned int nOutputs = 1, double reg = 1.0);
+
+    /** Reset the model to \f$ A = \lambda I \f$, \f$ B = 0 \f$, \f$ W = 0 \f$.
+     * @param nFeatures The number of features d.
+     * @param nOutputs The number of outputs t.
+     * @param reg The regularization parameter lambda. */
+    void reset(unsigned int nFeatures, unsigned int nOutputs, double reg);
+
+    /** Batch training from scratch.
+     * @param X Row-major n x d matrix of features.
+     * @param Y Row-major n x t matrix of outputs.
+     * @param n Number of samples.
+     * @return False if A is not positive definite. */
+    bool train(const double *X, const double *Y, long unsigned int n);
+
+    /** Batch training from scratch with the regularization parameter selected on a hold-out split,
+     * as the GURLS hold-out parameter selection did: the last holdOut * n samples are used for
+     * validation, nLambda values of lambda are tried on a geometric grid between
+     * \f$ 200 \sqrt{\epsilon} \, \mathrm{tr}(X^T X) \f$ and \f$ \mathrm{tr}(X^T X) \f$ of the training part,
+     * and the model is retrained on all the n samples with the lambda of least validation RMSE.
+     * Each candidate costs one \f$ O(d^3) \f$ factorization of the shared Gram matrix.
+     * @param X Row-major n x d matrix of features.
+     * @param Y Row-major n x t matrix of outputs.
+     * @param n Number of samples.
+     * @param holdOut Fraction of the samples used for validation (0: the current lambda is kept).
+     * @param nLambda Number of candidate values of lambda.
+     * @return False if no candidate gives a positive definite matrix. */
+    bool trainHoldOut(const double *X, const double *Y, long unsigned int n, double holdOut = 0.2, int nLambda = 20);
+
+    /** Absorb a new sample in the model with one rank-1 Cholesky update.
+     * @param x Feature vector (size d).
+     * @param y Output vector (size t). */
+    void update(const double *x, const double *y);
+
+    /** Remove a previously absorbed sample from the model with one rank-1 Cholesky downdate,
+     * \f$ A \leftarrow A - x x^T \f$, \f$ B \leftarrow B - x y^T \f$, in \f$ O(d^2 + dt) \f$.
+     * The weights are corrected as \f$ W \leftarrow W - A^{-1} x (y - W^T x)^T \f$ with the downdated A.
+     * @param x Feature vector (size d).
+     * @param y Output vector (size t).
+     * @return False if the downdated A would not be positive definite, in which case the model is unchanged. */
+    bool downdate(const double *x, const double *y);
+
+    /** Predict the outputs for the given features.
+     * @param x Feature vector (size d).
+     * @param y Output vector filled with the prediction (size t). */
+    void predict(const double *x, double *y) const;
+
+    /** Compute the predictive variance \f$ x^T A^{-1} x \f$ (in units of the noise variance)
+     * with a single triangular solve against the Cholesky factor, in \f$ O(d^2) \f$.
+     * @param x Feature vector (size d).
+     * @return The predictive variance. */
+    double predictiveVariance(const double *x) const;
+
+    /** @return The number of features d. */
+    inline unsigned int getFeatureSize() const { return d; }
+
+    /** @return The number of outputs t. */
+    inline unsigned int getOutputSize() const { return t; }
+
+    /** @return The regularization parameter. */
+    inline double getRegParam() const { return lambda; }
+
+    /** @return The number of samples absorbed by the model. */
+    inline long unsigned int getSampleCount() const { return sampleCount; }
+
+    /** @return The current weights, as a row-major d x t matrix. */
+    inline const std::vector<double> & getWeights() const { return W; }
+};
+
+#endif
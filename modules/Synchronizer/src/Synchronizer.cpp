@@ -19,10 +19,33 @@
 
 // Synchronizes position, velocity, acceleration and force/torque data to form a single Vector for further processing
 // Note: Velocity and acceleration are estimated in the callback of the read function, as soon as a new position sample is received
+// Note: The output is event-driven. Both streams are kept in short timestamped ring buffers and a sample is
+//       emitted as soon as the joint state covers the time stamp of an F/T reading. The joint state is linearly
+//       interpolated to the F/T time stamp, which is propagated in the envelope of the output.
+// Note: The joint selection, the anti-aliasing low-pass filter and the decimation of the raw state stream
+//       are performed here (joints, cutFreq, decimation), so no port monitor is needed on pos:i.
+// Note: With alignMode latest, each trigger sample is emitted on arrival with the latest sample of the other
+//       streams (no interpolation, no waiting), so the output follows the native rate of the F/T sensor.
+// Note: The output is written by a dedicated thread through a bounded queue. When the consumers do not keep up,
+//       the overflow policy (dropOldest, dropNewest, block) decides what is lost; the drops are
+//       reported by the stats RPC command.
+// Note: Any number of input streams (arms, torso, F/T sensors, IMU, ...) can be declared with the streams list.
+//       Each stream has its own group with the selected elements, the number of derivatives to estimate and
+//       the derivative settings; the output is the concatenation of all the streams, aligned on the time
+//       stamps of the trigger stream. Without the streams list, pos:i and ft:i are used as before.
 
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <random>
 
 #include <yarp/os/Network.h>
 #include <yarp/os/RFModule.h>
@@ -30,230 +53,1895 @@
 #include <yarp/os/Stamp.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Mutex.h>
+#include <yarp/os/Thread.h>
+#include <yarp/os/Semaphore.h>
+#include <yarp/os/Vocab.h>
 #include <yarp/sig/Vector.h>
 
+#include "shmChannel.h"
+#include "rtConfig.h"
+
+// ctrlLib is optional: it is only needed by the --awCompare mode
+#ifdef SYNCHRONIZER_HAS_CTRLLIB
 #include <iCub/ctrl/adaptWinPolyEstimator.h>
+#endif
 
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
+#ifdef SYNCHRONIZER_HAS_CTRLLIB
 using namespace iCub::ctrl;
+#endif
 
-// A class which handles the incoming data.
-// The estimated derivatives are returned at once
-// since they are computed within the onRead method.
-class dataCollector : public BufferedPort<Bottle>
+// Fixed-capacity ring buffer of timestamped vectors of constant width.
+// When full, pushing a new element overwrites the oldest one.
+class stampedRing
 {
 private:
-    AWLinEstimator       *linEst;
-    AWQuadEstimator      *quadEst;
+    vector<double>  data;
+    vector<double>  stamps;
+    size_t          width;
+    size_t          capacity;
+    size_t          head;       // Index of the oldest element
+    size_t          count;
     
-    Vector* PVABuffer;      // pointer to the Vector which contains q, qdot, qdotdot
-    Mutex* PVABufferMutex;  // pointer to the Mutex that protects the access to internal buffer containing q, qdot, qdotdot
+public:
+    stampedRing() : width(0), capacity(0), head(0), count(0)
+    {
+    }
     
+    void resize(size_t _capacity, size_t _width)
+    {
+        capacity = _capacity;
+        width = _width;
+        data.assign(capacity * width, 0.0);
+        stamps.assign(capacity, 0.0);
+        head = 0;
+        count = 0;
+    }
     
-    virtual void onRead(Bottle &b)
+    // Returns the slot to be filled with the new element. Returns true in overwritten if the oldest element was lost.
+    double* push(double stamp, bool &overwritten)
     {
-        Stamp info;
-        BufferedPort<Bottle>::getEnvelope(info);
+        overwritten = (count == capacity);
+        if (overwritten)
+            popFront();
+        size_t idx = (head + count) % capacity;
+        stamps[idx] = stamp;
+        ++count;
+        return &data[idx * width];
+    }
+    
+    void popFront()
+    {
+        head = (head + 1) % capacity;
+        --count;
+    }
+    
+    // Element i, with i = 0 the oldest one
+    const double* at(size_t i) const    { return &data[((head + i) % capacity) * width]; }
+    double stamp(size_t i) const        { return stamps[(head + i) % capacity]; }
+    double newestStamp() const          { return stamp(count - 1); }
+    size_t size() const                 { return count; }
+    size_t getCapacity() const          { return capacity; }
+    bool empty() const                  { return count == 0; }
+};
+
+// Single-producer ring buffer of timestamped samples, protected by one sequence lock per slot.
+// The producer (stream callback) never waits: it overwrites the oldest slot when the ring is full.
+// The consumer copies a slot and retries if the producer wrote it meanwhile, so it never sees a torn
+// snapshot. Each slot also stores the absolute index of its sample, which tells the
+// consumer whether the sample it asked for has already been overwritten.
+class seqlockRing
+{
+private:
+    atomic<unsigned int>*       seq;        // Per-slot sequence: odd while the slot is being written
+    vector<double>              data;
+    vector<double>              stamps;
+    vector<unsigned long int>   indices;    // Absolute index of the sample stored in each slot
+    size_t                      width;
+    size_t                      capacity;
+    atomic<unsigned long int>   published;  // Number of samples published so far
+    
+public:
+    seqlockRing() : seq(0), width(0), capacity(0), published(0)
+    {
+    }
+    
+    ~seqlockRing()
+    {
+        delete [] seq;
+    }
+    
+    // Not thread safe: call before the producer and the consumer are started
+    void resize(size_t _capacity, size_t _width)
+    {
+        delete [] seq;
+        capacity = _capacity;
+        width = _width;
+        seq = new atomic<unsigned int>[capacity];
+        for (size_t i = 0 ; i < capacity ; ++i)
+            seq[i].store(0);
+        data.assign(capacity * width, 0.0);
+        stamps.assign(capacity, 0.0);
+        indices.assign(capacity, 0);
+        published.store(0);
+    }
+    
+    // Producer side
+    void push(double stamp, const double* src)
+    {
+        unsigned long int idx = published.load(memory_order_relaxed);
+        size_t slot = idx % capacity;
+        double* dst = &data[slot * width];
         
-        size_t xsz = b.size();
-        Vector x(xsz);
+        seq[slot].fetch_add(1, memory_order_relaxed);       // odd: write in progress
+        atomic_thread_fence(memory_order_release);
+        for (size_t i = 0 ; i < width ; ++i)
+            dst[i] = src[i];
+        stamps[slot] = stamp;
+        indices[slot] = idx;
+        seq[slot].fetch_add(1, memory_order_release);       // even: write completed
+        
+        published.store(idx + 1, memory_order_release);
+    }
+    
+    // Consumer side. Copies sample idx into dst; returns false if it has been overwritten.
+    bool read(unsigned long int idx, double &stamp, double* dst) const
+    {
+        size_t slot = idx % capacity;
+        const double* src = &data[slot * width];
+        while (true)
+        {
+            unsigned int s0 = seq[slot].load(memory_order_acquire);
+            if (s0 & 1)
+                continue;       // write in progress
+            for (size_t i = 0 ; i < width ; ++i)
+                dst[i] = src[i];
+            stamp = stamps[slot];
+            unsigned long int storedIdx = indices[slot];
+            atomic_thread_fence(memory_order_acquire);
+            if (seq[slot].load(memory_order_relaxed) == s0)
+                return storedIdx == idx;
+        }
+    }
+    
+    unsigned long int getPublished() const  { return published.load(memory_order_acquire); }
+    size_t getCapacity() const              { return capacity; }
+};
+
+// Consumer-side view of an input stream which is interpolated at the trigger time stamps.
+// The producer (the stream callback) publishes the samples through a seqlockRing; the aligner keeps a copy
+// of the two samples bracketing the time stamp of the oldest pending trigger sample.
+class alignedStream
+{
+public:
+    seqlockRing           ring;         // Timestamped samples (lock-free handoff)
+    vector<double>        lo;
+    vector<double>        hi;
+    double                loStamp;
+    double                hiStamp;
+    bool                  haveLo;
+    bool                  haveHi;
+    unsigned long int     nextSample;   // Index of the next sample to be read from ring
+    long unsigned int     skipped;      // Samples overwritten before the aligner could read them
+    
+    alignedStream() : loStamp(0.0), hiStamp(0.0), haveLo(false), haveHi(false), nextSample(0), skipped(0)
+    {
+    }
+    
+    void configure(size_t bufLen, size_t width)
+    {
+        ring.resize(bufLen, width);
+        lo.assign(width, 0.0);
+        hi.assign(width, 0.0);
+    }
+    
+    // Moves the bracket [lo, hi] forward until hi is not older than tf.
+    // Returns false if the stream has not reached tf yet.
+    bool advanceTo(double tf)
+    {
+        while (!haveHi || hiStamp < tf)
+        {
+            unsigned long int published = ring.getPublished();
+            if (nextSample == published)
+                return false;
+            
+            // Skip the samples the producer has already overwritten
+            if (published - nextSample > ring.getCapacity())
+            {
+                skipped += published - ring.getCapacity() - nextSample;
+                nextSample = published - ring.getCapacity();
+            }
+            
+            double stamp;
+            if (!ring.read(nextSample, stamp, &lo[0]))
+            {
+                ++skipped;
+                ++nextSample;
+                continue;
+            }
+            ++nextSample;
+            
+            // The sample just read becomes hi, the previous hi becomes lo
+            lo.swap(hi);
+            loStamp = hiStamp;
+            haveLo = haveHi;
+            hiStamp = stamp;
+            haveHi = true;
+        }
+        return true;
+    }
+    
+    // Moves hi to the newest published sample, skipping the older ones.
+    // Returns false if no sample has been published yet.
+    bool advanceToLatest()
+    {
+        unsigned long int published = ring.getPublished();
+        if (nextSample < published)
+        {
+            double stamp;
+            if (ring.read(published - 1, stamp, &lo[0]))
+            {
+                lo.swap(hi);
+                hiStamp = stamp;
+                haveHi = true;
+            }
+            nextSample = published;
+        }
+        return haveHi;
+    }
+    
+    // False if all the available samples are newer than tf
+    bool covers(double tf) const
+    {
+        return !(hiStamp > tf && (!haveLo || loStamp > tf));
+    }
+    
+    // Writes the sample linearly interpolated at time tf
+    void interpolate(double tf, double* dst) const
+    {
+        size_t width = lo.size();
+        if (haveLo && hiStamp > tf && hiStamp > loStamp)
+        {
+            double alpha = (tf - loStamp) / (hiStamp - loStamp);
+            for (size_t i = 0 ; i < width ; ++i)
+                dst[i] = lo[i] + alpha * (hi[i] - lo[i]);
+        }
+        else
+        {
+            for (size_t i = 0 ; i < width ; ++i)
+                dst[i] = hi[i];
+        }
+    }
+};
 
-        cout << "Received position bottle: " << b.toString() << endl;
+// Bounded queue between the aligner and the output port, drained by its own thread, so that the input
+// callbacks never wait for the consumers. A new message is written only when the previous one has been
+// sent to all the connections; meanwhile the samples are queued and, when the queue is full, the overflow
+// policy decides what is lost:
+//   dropOldest: the oldest queued sample is overwritten
+//   dropNewest: the new sample is discarded
+//   block:      the aligner waits for a free slot, and so do the input callbacks
+// Each message carries exactly one sample, since the consumers read one sample per message.
+class outputQueue : public Thread
+{
+public:
+    enum overflowPolicy { DROP_OLDEST, DROP_NEWEST, BLOCK };
+
+private:
+    BufferedPort<Vector>* port;
+    overflowPolicy        policy;
+    stampedRing           queue;        // Timestamped samples waiting to be written
+    size_t                width;        // Size of one sample
+    Mutex                 mutex;        // Protects queue and statistics
+    Semaphore             available;    // Posted for each queued sample
+    Semaphore             space;        // Free slots of the queue (block policy)
+    int                   outCount;     // Sequence number of the output envelope
+    shmChannel::writer    shmOut;       // Shared memory channel to a consumer on the same host, if any
+    double                lastShmCheck; // Time of the last check for a shared memory consumer
+    bool                  shmConsumer;  // A shared memory consumer was found at the last check
+    rtConfig::settings    rt;           // Realtime options of the writer thread
+    
+    // Statistics
+    long unsigned int     queued;       // Samples accepted in the queue
+    long unsigned int     sent;         // Samples written to the port
+    long unsigned int     messages;     // Messages written to the port
+    long unsigned int     dropped;      // Samples lost because of the overflow policy
+    size_t                maxQueued;    // Maximum number of samples waiting in the queue
+
+public:
+    outputQueue() : port(0), policy(DROP_OLDEST), width(0), available(0), space(0), outCount(0),
+                    lastShmCheck(-1e9), shmConsumer(false),
+                    queued(0), sent(0), messages(0), dropped(0), maxQueued(0)
+    {
+    }
+    
+    static bool parsePolicy(const string &name, overflowPolicy &p)
+    {
+        if (name == "dropOldest")       p = DROP_OLDEST;
+        else if (name == "dropNewest")  p = DROP_NEWEST;
+        else if (name == "block")       p = BLOCK;
+        else                            return false;
+        return true;
+    }
+    
+    // Not thread safe: call before start()
+    void configure(BufferedPort<Vector>* _port, size_t _width, size_t capacity, overflowPolicy _policy)
+    {
+        port = _port;
+        width = _width;
+        policy = _policy;
+        queue.resize(capacity, width);
+        for (size_t i = 0 ; i < capacity ; ++i)
+            space.post();
+        shmOut.open(port->getName().c_str());
+    }
+    
+    // Not thread safe: call before start()
+    void setRealtime(const rtConfig::settings &_rt)
+    {
+        rt = _rt;
+    }
+    
+    virtual bool threadInit()
+    {
+        rtConfig::configureThread(rt, 0, "output writer");
+        return true;
+    }
+    
+    // True if some consumer reads the output, either from the port or from the shared memory channel
+    bool hasConsumers()
+    {
+        if (port->getOutputCount() > 0)
+            return true;
+        double now = Time::now();
+        if (now - lastShmCheck > 1.0)
+        {
+            lastShmCheck = now;
+            shmConsumer = shmChannel::consumerExists(port->getName().c_str());
+        }
+        return shmConsumer;
+    }
+    
+    // Copies the sample in the queue. Returns false if it has been discarded.
+    bool push(double stamp, const double* x)
+    {
+        if (policy == BLOCK)
+            space.wait();
+        
+        mutex.lock();
+        if (policy == DROP_NEWEST && queue.size() == queue.getCapacity())
+        {
+            ++dropped;
+            mutex.unlock();
+            return false;
+        }
+        bool overwritten;
+        double* slot = queue.push(stamp, overwritten);
+        for (size_t i = 0 ; i < width ; ++i)
+            slot[i] = x[i];
+        if (overwritten)
+            ++dropped;
+        ++queued;
+        if (queue.size() > maxQueued)
+            maxQueued = queue.size();
+        mutex.unlock();
         
-        for (int i=0; i < b.size(); i++) {
-            x[i] = b.get(i).asDouble();
-            cout << "x[" << i <<"] =" << x[i] <<endl;
+        available.post();
+        return true;
+    }
+    
+    virtual void run()
+    {
+        while (true)
+        {
+            available.wait();
+            if (isStopping())
+                break;
+            
+            // Wait until the previous message has been sent to all the connections
+            port->waitForWrite();
+            
+            mutex.lock();
+            if (queue.size() == 0)
+            {
+                // The posts of the samples overwritten by dropOldest find the queue empty
+                mutex.unlock();
+                continue;
+            }
+            
+            Vector &v = port->prepare();
+            v.resize(width);
+            const double* src = queue.at(0);
+            for (size_t i = 0 ; i < width ; ++i)
+                v[i] = src[i];
+            double stamp = queue.stamp(0);
+            queue.popFront();
+            ++sent;
+            ++messages;
+            mutex.unlock();
+            
+            if (policy == BLOCK)
+                space.post();
+            
+            shmOut.write(stamp, v.data(), v.size());
+            
+            // the envelope carries the time stamp of the sample
+            Stamp info(++outCount, stamp);
+            port->setEnvelope(info);
+            port->write();
         }
+    }
+    
+    // Wakes up the writer and any producer waiting for a free slot
+    virtual void onStop()
+    {
+        available.post();
+        space.post();
+    }
+    
+    void addStats(Bottle &reply)
+    {
+        static const char* names[] = { "dropOldest", "dropNewest", "block" };
+        mutex.lock();
+        reply.addString("overflow");
+        reply.addString(names[policy]);
+        reply.addString("queued");
+        reply.addInt(queued);
+        reply.addString("sent");
+        reply.addInt(sent);
+        reply.addString("messages");
+        reply.addInt(messages);
+        reply.addString("droppedOut");
+        reply.addInt(dropped);
+        reply.addString("pendingOut");
+        reply.addInt(queue.size());
+        reply.addString("maxPendingOut");
+        reply.addInt(maxQueued);
+        mutex.unlock();
+    }
+};
 
-        // for the estimation the time stamp
-        // is required. If not present within the
-        // packet, the actual machine time is 
-        // attached to it.
-        AWPolyElement el(x,info.isValid()?info.getTime():Time::now());
+// Aligns an arbitrary number of input streams on the time stamps of one of them, the trigger stream
+// (by default the F/T sensor). The samples of the trigger stream are queued; the other streams are
+// handed over through seqlockRings, so their callbacks never block, and are interpolated at the
+// trigger time stamps. The output is the concatenation of all the streams, in configuration order,
+// and is written as soon as it is available, from whichever callback completes it.
+class sampleAligner
+{
+private:
+    BufferedPort<Vector>*   outPort;    // Output vector, e.g. [ q , qdot, qdotdot, F, T ]
+    vector<alignedStream*>  streams;    // Interpolated streams (0 for the trigger stream)
+    vector<size_t>          offsets;    // Offset of each stream in the output vector
+    vector<size_t>          widths;     // Size of each stream sample
+    size_t                  outSize;    // Size of the output vector
+    size_t                  trigger;    // Index of the trigger stream
+    stampedRing             trigRing;   // Timestamped trigger samples waiting for the other streams
+    Mutex                   alignMutex; // Protects the consumer side: trigRing, alignedStreams and statistics
+    vector<double>          sample;     // Preallocated output sample
+    outputQueue             outQueue;   // Decouples the output port from the aligner
+    bool                    latest;     // Use the latest sample of each stream instead of waiting to interpolate
+    
+    // Statistics
+    long unsigned int     numTrig;      // Received trigger samples
+    long unsigned int     numOut;       // Emitted samples
+    long unsigned int     droppedTrig;  // Trigger samples older than any buffered sample of a stream, or overwritten
+    double                maxLag;       // Maximum delay between trigger stamp and emission
+    double                lastOut;      // Time of the previous emission
+    double                outPeriod;    // Exponentially weighted time between emissions
+    
+    // Emits the trigger sample right away with the latest sample of each stream. Called with alignMutex locked.
+    void alignLatest()
+    {
+        while (!trigRing.empty())
+        {
+            bool available = true;
+            for (size_t s = 0 ; s < streams.size() ; ++s)
+                if (streams[s] != 0 && !streams[s]->advanceToLatest())
+                    available = false;
+            if (available)
+                emit(trigRing.stamp(0));
+            else
+                ++droppedTrig;
+            trigRing.popFront();
+        }
+    }
+    
+    // Emits all the trigger samples covered by the other streams. Called with alignMutex locked.
+    void align()
+    {
+        while (!trigRing.empty())
+        {
+            double tf = trigRing.stamp(0);
+            
+            // Wait until all the streams have reached the trigger time stamp
+            bool reached = true;
+            for (size_t s = 0 ; s < streams.size() && reached ; ++s)
+                if (streams[s] != 0)
+                    reached = streams[s]->advanceTo(tf);
+            if (!reached)
+                break;
+            
+            // The trigger sample is older than all the available samples of some stream
+            bool covered = true;
+            for (size_t s = 0 ; s < streams.size() && covered ; ++s)
+                if (streams[s] != 0)
+                    covered = streams[s]->covers(tf);
+            if (!covered)
+            {
+                trigRing.popFront();
+                ++droppedTrig;
+                continue;
+            }
+            
+            emit(tf);
+            trigRing.popFront();
+        }
+    }
+    
+    // Writes the output sample, interpolating the streams to time tf
+    void emit(double tf)
+    {
+        if (!outQueue.hasConsumers())
+            return;
         
-        // Protect ON
-        PVABufferMutex->lock();
+        for (size_t s = 0 ; s < streams.size() ; ++s)
+        {
+            double* dst = &sample[offsets[s]];
+            if (streams[s] != 0)
+            {
+                // In latest mode lo is not a valid bracket, the newest sample is held
+                if (latest)
+                    for (size_t i = 0 ; i < widths[s] ; ++i)
+                        dst[i] = streams[s]->hi[i];
+                else
+                    streams[s]->interpolate(tf, dst);
+            }
+            else
+            {
+                const double* src = trigRing.at(0);
+                for (size_t i = 0 ; i < widths[s] ; ++i)
+                    dst[i] = src[i];
+            }
+        }
         
-        PVABuffer->setSubvector( 0 , x );
-        PVABuffer->setSubvector( xsz , linEst->estimate(el) );
-        PVABuffer->setSubvector( 2*xsz , quadEst->estimate(el) );
+        // the outbound packets carry the time stamp of the trigger sample
+        if (!outQueue.push(tf, &sample[0]))
+            return;
         
-        PVABufferMutex->unlock();
-        // Protect OFF        
+        ++numOut;
+        double now = Time::now();
+        double lag = now - tf;
+        if (lag > maxLag)
+            maxLag = lag;
+        if (numOut == 2)
+            outPeriod = now - lastOut;
+        else if (numOut > 2)
+            outPeriod += 0.05 * ((now - lastOut) - outPeriod);
+        lastOut = now;
     }
-
+    
 public:
-    dataCollector(unsigned int NVel, double DVel, 
-                  unsigned int NAcc, double DAcc,
-                  Vector* buf,
-                  Mutex* bufMut)
+    sampleAligner() : outPort(0), outSize(0), trigger(0), latest(false),
+                      numTrig(0), numOut(0), droppedTrig(0), maxLag(0.0), lastOut(0.0), outPeriod(0.0)
     {
-        linEst  = new AWLinEstimator(NVel,DVel);
-        quadEst = new AWQuadEstimator(NAcc,DAcc);
-        PVABuffer = buf;
-        PVABufferMutex = bufMut;
     }
-
-    ~dataCollector()
+    
+    ~sampleAligner()
+    {
+        for (size_t s = 0 ; s < streams.size() ; ++s)
+            delete streams[s];
+    }
+    
+    // Not thread safe: call before configure()
+    void setRealtime(const rtConfig::settings &rt)
+    {
+        outQueue.setRealtime(rt);
+    }
+    
+    // Not thread safe: call before opening the input ports
+    // If _latest is true, each trigger sample is emitted on arrival with the latest sample of the other streams
+    void configure(BufferedPort<Vector>* _outPort, const vector<size_t> &_widths, size_t _trigger, size_t bufLen,
+                   bool _latest, outputQueue::overflowPolicy policy, size_t outQueueLen)
+    {
+        outPort = _outPort;
+        latest = _latest;
+        widths = _widths;
+        trigger = _trigger;
+        
+        streams.assign(widths.size(), (alignedStream*)0);
+        offsets.assign(widths.size(), 0);
+        outSize = 0;
+        for (size_t s = 0 ; s < widths.size() ; ++s)
+        {
+            offsets[s] = outSize;
+            outSize += widths[s];
+            if (s == trigger)
+                trigRing.resize(bufLen, widths[s]);
+            else
+            {
+                streams[s] = new alignedStream;
+                streams[s]->configure(bufLen, widths[s]);
+            }
+        }
+        
+        sample.assign(outSize, 0.0);
+        outQueue.configure(outPort, outSize, outQueueLen, policy);
+        outQueue.start();
+    }
+    
+    // Call after closing the input ports
+    void stopOutput()
     {
-        delete linEst;
-        delete quadEst;
+        outQueue.stop();
+    }
+    
+    // Called by the callback of stream s with a sample of widths[s] elements.
+    // The non-trigger streams never block.
+    void pushSample(size_t s, double stamp, const double* x)
+    {
+        if (s != trigger)
+        {
+            streams[s]->ring.push(stamp, x);
+            if (latest)
+                return;
+            
+            // Emit the trigger samples waiting for this one, unless another callback is already aligning:
+            // in that case the new sample is consumed by that callback or, at the latest, by the next one.
+            if (alignMutex.tryLock())
+            {
+                align();
+                alignMutex.unlock();
+            }
+            return;
+        }
+        
+        alignMutex.lock();
+        bool overwritten;
+        double* slot = trigRing.push(stamp, overwritten);
+        for (size_t i = 0 ; i < widths[s] ; ++i)
+            slot[i] = x[i];
+        if (overwritten)
+            ++droppedTrig;
+        ++numTrig;
+        if (latest)
+            alignLatest();
+        else
+            align();
+        alignMutex.unlock();
+    }
+    
+    size_t getOutputSize() const    { return outSize; }
+    size_t getTrigger() const       { return trigger; }
+    
+    void addStats(Bottle &reply)
+    {
+        alignMutex.lock();
+        reply.addString("trigger");
+        reply.addInt(numTrig);
+        reply.addString("out");
+        reply.addInt(numOut);
+        reply.addString("droppedTrigger");
+        reply.addInt(droppedTrig);
+        reply.addString("pendingTrigger");
+        reply.addInt(trigRing.size());
+        reply.addString("maxLag_ms");
+        reply.addDouble(1000.0 * maxLag);
+        reply.addString("outRate_Hz");
+        reply.addDouble(outPeriod > 0.0 ? 1.0 / outPeriod : 0.0);
+        alignMutex.unlock();
+        outQueue.addStats(reply);
+    }
+    
+    // Samples of stream s overwritten before being aligned
+    long unsigned int getSkipped(size_t s)
+    {
+        alignMutex.lock();
+        long unsigned int skipped = (streams[s] != 0) ? streams[s]->skipped : 0;
+        alignMutex.unlock();
+        return skipped;
     }
 };
 
-class Synchronizer: public RFModule
+// Adaptive window polynomial estimator of the first (order 1) or second (order 2) derivative of a signal.
+// It follows the criterion of iCub::ctrl::AWLinEstimator and AWQuadEstimator: for each component the window
+// grows from order+1 samples up to N samples as long as all the residuals of the least squares polynomial fit
+// stay within D, and the derivative is taken from the largest admissible window.
+// The history is kept in a ring buffer and the estimate is written in place, so no memory is allocated
+// after configure().
+// In incremental mode the moments of the fit are accumulated while the window grows, so that each window
+// fit costs O(1) and each sample O(N) per component instead of O(N^2). Since the maximum residual cannot be
+// obtained from the moments, the window is then admissible if the RMS residual stays within D.
+class awPolyEstimator
 {
 private:
+    unsigned int    order;      // 1: velocity, 2: acceleration
+    unsigned int    N;          // Maximum window length
+    double          D;          // Maximum admissible residual
+    size_t          dim;        // Signal dimension
+    bool            incremental;// Grow the window with running moments and an RMS residual test
+    vector<double>  hist;       // Ring buffer of N samples of dim elements
+    vector<double>  times;      // Ring buffer of N time stamps
+    size_t          newest;     // Index of the newest sample
+    size_t          count;      // Number of stored samples
+    vector<double>  Sx;         // Incremental mode workspace: sums of x * tau^p for each component
+    vector<double>  Sxx;        // Incremental mode workspace: sums of x^2 for each component
+    vector<char>    done;       // Incremental mode workspace: window growth stopped for the component
+    
+    // Index of the k-th newest sample (k = 0 is the newest)
+    inline size_t idx(size_t k) const { return (newest + N - k) % N; }
+    
+    // Least squares fit of x_k = c0 + c1*tau_k (+ c2*tau_k^2) on the n newest samples of component i,
+    // with tau_k relative to the newest time stamp. Returns false if the fit is degenerate.
+    bool fit(size_t n, size_t i, double* c) const
+    {
+        double S[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };     // sums of tau^p
+        double Sx[3] = { 0.0, 0.0, 0.0 };               // sums of x * tau^p
+        double t0 = times[newest];
+        for (size_t k = 0 ; k < n ; ++k)
+        {
+            size_t j = idx(k);
+            double tau = times[j] - t0;
+            double x = hist[j*dim + i];
+            double taup = 1.0;
+            for (unsigned int p = 0 ; p <= 2*order ; ++p)
+            {
+                S[p] += taup;
+                if (p <= order)
+                    Sx[p] += x * taup;
+                taup *= tau;
+            }
+        }
+        return solveNormalEquations(S, Sx, c);
+    }
+    
+    // Solves the (order+1)x(order+1) Hankel normal equations built from the moments S and Sx
+    bool solveNormalEquations(const double* S, const double* Sx, double* c) const
+    {
+        if (order == 1)
+        {
+            double det = S[0]*S[2] - S[1]*S[1];
+            if (det <= 0.0)
+                return false;
+            c[1] = (S[0]*Sx[1] - S[1]*Sx[0]) / det;
+            c[0] = (Sx[0] - c[1]*S[1]) / S[0];
+            return true;
+        }
+        
+        // Cramer's rule on [S0 S1 S2 ; S1 S2 S3 ; S2 S3 S4]
+        double m00 = S[2]*S[4] - S[3]*S[3];
+        double m01 = S[1]*S[4] - S[3]*S[2];
+        double m02 = S[1]*S[3] - S[2]*S[2];
+        double det = S[0]*m00 - S[1]*m01 + S[2]*m02;
+        if (fabs(det) <= 1e-300)
+            return false;
+        c[0] = (Sx[0]*m00 - S[1]*(Sx[1]*S[4] - S[3]*Sx[2]) + S[2]*(Sx[1]*S[3] - S[2]*Sx[2])) / det;
+        c[1] = (S[0]*(Sx[1]*S[4] - S[3]*Sx[2]) - Sx[0]*m01 + S[2]*(S[1]*Sx[2] - Sx[1]*S[2])) / det;
+        c[2] = (S[0]*(S[2]*Sx[2] - Sx[1]*S[3]) - S[1]*(S[1]*Sx[2] - Sx[1]*S[2]) + Sx[0]*m02) / det;
+        return true;
+    }
+    
+    // Grows the windows of all the components at once, updating the moments with one sample per step.
+    // The time moments are shared by all the components; the signal is centered on its newest value.
+    void estimateIncremental(double* out)
+    {
+        double S[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        double t0 = times[newest];
+        size_t active = dim;
+        for (size_t i = 0 ; i < dim ; ++i)
+        {
+            out[i] = 0.0;
+            Sx[3*i] = Sx[3*i + 1] = Sx[3*i + 2] = 0.0;
+            Sxx[i] = 0.0;
+            done[i] = 0;
+        }
+        
+        double c[3];
+        for (size_t n = 1 ; n <= count && active > 0 ; ++n)
+        {
+            size_t j = idx(n - 1);
+            double tau = times[j] - t0;
+            double taup[5];
+            taup[0] = 1.0;
+            for (unsigned int p = 1 ; p <= 2*order ; ++p)
+                taup[p] = taup[p-1] * tau;
+            for (unsigned int p = 0 ; p <= 2*order ; ++p)
+                S[p] += taup[p];
+            
+            for (size_t i = 0 ; i < dim ; ++i)
+            {
+                if (done[i])
+                    continue;
+                double x = hist[j*dim + i] - hist[newest*dim + i];
+                double* Sxi = &Sx[3*i];
+                for (unsigned int p = 0 ; p <= order ; ++p)
+                    Sxi[p] += x * taup[p];
+                Sxx[i] += x * x;
+                
+                if (n < order + 1 || !solveNormalEquations(S, Sxi, c))
+                    continue;
+                
+                if (n > order + 1)
+                {
+                    // Residual sum of squares of the least squares fit: x'x - c'(T'x)
+                    double sse = Sxx[i];
+                    for (unsigned int p = 0 ; p <= order ; ++p)
+                        sse -= c[p] * Sxi[p];
+                    if (sse > n * D * D)
+                    {
+                        done[i] = 1;
+                        --active;
+                        continue;
+                    }
+                }
+                out[i] = (order == 1) ? c[1] : 2.0*c[2];
+            }
+        }
+    }
+    
+    // Maximum absolute residual of the fit c on the n newest samples of component i
+    double maxResidual(size_t n, size_t i, const double* c) const
+    {
+        double t0 = times[newest];
+        double res = 0.0;
+        for (size_t k = 0 ; k < n ; ++k)
+        {
+            size_t j = idx(k);
+            double tau = times[j] - t0;
+            double fitted = c[0] + tau*(c[1] + (order == 2 ? tau*c[2] : 0.0));
+            double e = fabs(hist[j*dim + i] - fitted);
+            if (e > res)
+                res = e;
+        }
+        return res;
+    }
+    
+public:
+    awPolyEstimator() : order(1), N(2), D(1.0), dim(0), incremental(false), newest(0), count(0)
+    {
+    }
+    
+    void configure(unsigned int _order, unsigned int _N, double _D, size_t _dim, bool _incremental = false)
+    {
+        order = _order;
+        N = _N;
+        D = _D;
+        dim = _dim;
+        incremental = _incremental;
+        hist.assign(N * dim, 0.0);
+        times.assign(N, 0.0);
+        newest = N - 1;
+        count = 0;
+        Sx.assign(3 * dim, 0.0);
+        Sxx.assign(dim, 0.0);
+        done.assign(dim, 0);
+    }
+    
+    // Adds the sample x taken at time t and writes the derivative estimate in out (both of size dim)
+    void estimate(double t, const double* x, double* out)
+    {
+        newest = (newest + 1) % N;
+        times[newest] = t;
+        for (size_t i = 0 ; i < dim ; ++i)
+            hist[newest*dim + i] = x[i];
+        if (count < N)
+            ++count;
+        
+        if (incremental)
+        {
+            estimateIncremental(out);
+            return;
+        }
+        
+        double c[3];
+        for (size_t i = 0 ; i < dim ; ++i)
+        {
+            out[i] = 0.0;
+            for (size_t n = order + 1 ; n <= count ; ++n)
+            {
+                if (!fit(n, i, c))
+                    continue;
+                if (n > order + 1 && maxResidual(n, i, c) > D)
+                    break;
+                out[i] = (order == 1) ? c[1] : 2.0*c[2];
+            }
+        }
+    }
+};
 
-    dataCollector        *port_pos;     // Input Vector [ q ]
-    BufferedPort<Bottle>  FTport;       // Input Force/torque data    [ F , T ]
-    BufferedPort<Vector>  outPort;      // Output vector [ q , qdot, qdotdot, F, T ]
-    Port                  rpcPort;      
-    Vector*               FTVector;
-    size_t                t;            // Size of the F/T vector
-    size_t                xsz;          // Size of the F/T vector
+// Configuration of one input stream
+struct streamConfig
+{
+    string          name;           // Name of the stream, also the name of its group in the configuration
+    string          port;           // Port name suffix
+    vector<int>     joints;         // Indices of the selected elements of the incoming bottle
+    int             derivatives;    // 0: values only, 1: values and first derivative, 2: also second derivative
+    unsigned int    NVel;           // Velocity window's max length
+    double          DVel;           // Velocity max deviation threshold
+    unsigned int    NAcc;           // Acceleration window's max length
+    double          DAcc;           // Acceleration max deviation threshold
+    bool            incremental;    // Incremental adaptive window test
+    int             decimation;     // Forward one sample every 'decimation' received
+    double          cutFreq;        // Cut frequency of the anti-aliasing filter (0: disabled)
+    
+    // Size of the stream sample [ x , xdot , xdotdot ]
+    size_t width() const { return joints.size() * (1 + derivatives); }
+};
+
+// A class which handles the incoming data of one stream.
+// The selected elements are low-pass filtered and decimated, then the estimated
+// derivatives are appended, since they are computed within the onRead method.
+class streamCollector : public BufferedPort<Bottle>
+{
+private:
+    size_t               id;            // Index of the stream in the aligner
+    streamConfig         cfg;
+    awPolyEstimator      linEst;
+    awPolyEstimator      quadEst;
+    size_t               nj;            // Number of selected elements
+    int                  decimCount;    // Samples received since the last forwarded one
+    double               tau;           // Time constant of the anti-aliasing low-pass filter (0: disabled)
+    double               lastStamp;     // Time stamp of the previous received sample
+    bool                 filterInit;    // False until the first sample initializes the filter
+    vector<double>       x;             // Preallocated sample [ x , xdot , xdotdot ]
+    rtConfig::settings   rt;            // Realtime options, applied to the callback thread at the first sample
+    bool                 rtApplied;
+    
+    sampleAligner* aligner;     // pointer to the aligner which receives the timestamped samples
+    
+    // Statistics
+    Mutex                statsMutex;
+    long unsigned int    received;      // Received samples
+    long unsigned int    forwarded;     // Samples forwarded to the aligner after decimation
+    double               lastArrival;   // Arrival time of the previous sample
+    double               period;        // Exponentially weighted inter-arrival time
+    long unsigned int    numStamped;    // Received samples with a valid envelope
+    double               latencySum;    // Sum of the delays between sender time stamp and arrival
+    double               maxLatency;    // Maximum delay between sender time stamp and arrival
+    
+    virtual void onRead(Bottle &b)
+    {
+        if (!rtApplied)
+        {
+            rtConfig::configureThread(rt, id + 1, cfg.name + " callback");
+            rtApplied = true;
+        }
+        
+        Stamp info;
+        BufferedPort<Bottle>::getEnvelope(info);
+        
+        // for the estimation the time stamp
+        // is required. If not present within the
+        // packet, the actual machine time is 
+        // attached to it.
+        double arrival = Time::now();
+        double stamp = info.isValid()?info.getTime():arrival;
+        
+        statsMutex.lock();
+        if (received == 1)
+            period = arrival - lastArrival;
+        else if (received > 1)
+            period += 0.05 * ((arrival - lastArrival) - period);
+        lastArrival = arrival;
+        ++received;
+        if (info.isValid())
+        {
+            double latency = arrival - stamp;
+            latencySum += latency;
+            if (latency > maxLatency)
+                maxLatency = latency;
+            ++numStamped;
+        }
+        statsMutex.unlock();
+        
+        // Select the elements and apply the first order anti-aliasing filter at the full input rate
+        double alpha = 1.0;
+        if (tau > 0.0 && filterInit)
+        {
+            double dt = stamp - lastStamp;
+            alpha = (dt > 0.0) ? dt / (dt + tau) : 0.0;
+        }
+        for (size_t i=0; i < nj; i++)
+        {
+            double xi = (cfg.joints[i] < b.size()) ? b.get(cfg.joints[i]).asDouble() : 0.0;
+            x[i] += alpha * (xi - x[i]);
+        }
+        filterInit = true;
+        lastStamp = stamp;
+        
+        // Decimation
+        if (++decimCount < cfg.decimation)
+            return;
+        decimCount = 0;
+        
+        if (cfg.derivatives >= 1)
+            linEst.estimate( stamp , &x[0] , &x[nj] );
+        if (cfg.derivatives >= 2)
+            quadEst.estimate( stamp , &x[0] , &x[2*nj] );
+        
+        aligner->pushSample( id , stamp , &x[0] );
+        
+        statsMutex.lock();
+        ++forwarded;
+        statsMutex.unlock();
+    }
 
 public:
+    streamCollector(size_t _id, const streamConfig &_cfg, sampleAligner* _aligner, const rtConfig::settings &_rt)
+        : id(_id), cfg(_cfg), nj(_cfg.joints.size()), decimCount(_cfg.decimation - 1),
+          tau(_cfg.cutFreq > 0.0 ? 1.0 / (2.0 * M_PI * _cfg.cutFreq) : 0.0), lastStamp(0.0), filterInit(false),
+          x(_cfg.width(), 0.0), rt(_rt), rtApplied(false), aligner(_aligner),
+          received(0), forwarded(0), lastArrival(0.0), period(0.0), numStamped(0), latencySum(0.0), maxLatency(0.0)
+    {
+        if (cfg.derivatives >= 1)
+            linEst.configure(1, cfg.NVel, cfg.DVel, nj, cfg.incremental);
+        if (cfg.derivatives >= 2)
+            quadEst.configure(2, cfg.NAcc, cfg.DAcc, nj, cfg.incremental);
+    }
     
-    Vector PVABuffer;      // Vector which contains q, qdot, qdotdot
-    Mutex PVABufferMutex;  // Mutex that protects the access to internal buffer containing q, qdot, qdotdot
+    const streamConfig & getConfig() const  { return cfg; }
     
-    virtual bool configure(ResourceFinder &rf)
+    void addStats(Bottle &reply)
     {
-        // request high resolution scheduling
-        Time::turboBoost();
+        Bottle &s = reply.addList();
+        statsMutex.lock();
+        s.addString(cfg.name.c_str());
+        s.addString("received");
+        s.addInt(received);
+        s.addString("forwarded");
+        s.addInt(forwarded);
+        s.addString("rate_Hz");
+        s.addDouble(period > 0.0 ? 1.0 / period : 0.0);
+        s.addString("latency_ms");
+        s.addDouble(numStamped > 0 ? 1000.0 * latencySum / numStamped : 0.0);
+        s.addString("maxLatency_ms");
+        s.addDouble(1000.0 * maxLatency);
+        statsMutex.unlock();
+        s.addString("skipped");
+        s.addInt(aligner->getSkipped(id));
+    }
+};
 
-        string portName=rf.check("name",Value("/Synchronizer")).asString().c_str();
+class Synchronizer: public RFModule
+{
+private:
 
-        unsigned int NVel=rf.check("lenVel",Value(16)).asInt();
-        unsigned int NAcc=rf.check("lenAcc",Value(25)).asInt();
+    vector<streamCollector*>  collectors;   // Input streams, e.g. [ q ] and [ F , T ]
+    BufferedPort<Vector>      outPort;      // Output vector, e.g. [ q , qdot, qdotdot, F, T ]
+    Port                      rpcPort;      
+    sampleAligner             aligner;      // Aligns the input streams on the trigger stream
 
-        double DVel=rf.check("thrVel",Value(1.0)).asDouble();
-        double DAcc=rf.check("thrAcc",Value(1.0)).asDouble();
+    // Reads the settings of a stream from its group, falling back to the defaults
+    bool readStreamConfig(Searchable &g, const streamConfig &def, streamConfig &cfg)
+    {
+        cfg = def;
+        cfg.port = g.check("port", Value(("/" + cfg.name + ":i").c_str())).asString().c_str();
         
-        t = rf.check("t", Value(6)).asInt();
-        xsz = rf.check("xsz", Value(4)).asInt();
-
-        FTVector = new Vector( t , 0.0 );         // Allocate F/T buffer Vector
+        Bottle* jointList = g.find("joints").asList();
+        if (jointList != 0 && jointList->size() > 0)
+        {
+            cfg.joints.clear();
+            for (int i = 0 ; i < jointList->size() ; ++i)
+                cfg.joints.push_back(jointList->get(i).asInt());
+        }
+        if (cfg.joints.empty())
+        {
+            cout<<"Error: no joints selected for stream "<<cfg.name<<endl;
+            return false;
+        }
+        
+        cfg.derivatives = g.check("derivatives", Value(def.derivatives)).asInt();
+        cfg.NVel = g.check("lenVel", Value((int)def.NVel)).asInt();
+        cfg.NAcc = g.check("lenAcc", Value((int)def.NAcc)).asInt();
+        cfg.DVel = g.check("thrVel", Value(def.DVel)).asDouble();
+        cfg.DAcc = g.check("thrAcc", Value(def.DAcc)).asDouble();
+        string awMode = g.check("awMode", Value(def.incremental ? "incremental" : "maxResidual")).asString().c_str();
+        cfg.decimation = g.check("decimation", Value(def.decimation)).asInt();
+        cfg.cutFreq = g.check("cutFreq", Value(def.cutFreq)).asDouble();
         
-        PVABufferMutex.lock();
-        PVABuffer.clear();
-        PVABuffer.resize(3*xsz + t , 0.0);
-        PVABufferMutex.unlock();
+        if (awMode != "maxResidual" && awMode != "incremental")
+        {
+            cout<<"Warning: unknown awMode "<<awMode<<" for stream "<<cfg.name<<" => maxResidual is assumed"<<endl;
+            awMode="maxResidual";
+        }
+        cfg.incremental = (awMode == "incremental");
+        
+        if (cfg.derivatives<0 || cfg.derivatives>2)
+        {
+            cout<<"Warning: derivatives must be 0, 1 or 2 for stream "<<cfg.name<<" => 0 is assumed"<<endl;
+            cfg.derivatives=0;
+        }
 
-        if (NVel<2)
+        if (cfg.NVel<2)
         {
             cout<<"Warning: lenVel cannot be lower than 2 => N=2 is assumed"<<endl;
-            NVel=2;
+            cfg.NVel=2;
         }
 
-        if (NAcc<3)
+        if (cfg.NAcc<3)
         {
             cout<<"Warning: lenAcc cannot be lower than 3 => N=3 is assumed"<<endl;
-            NAcc=3;
+            cfg.NAcc=3;
         }
 
-        if (DVel<0.0)
+        if (cfg.DVel<0.0)
         {
             cout<<"Warning: thrVel cannot be lower than 0.0 => D=0.0 is assumed"<<endl;
-            DVel=0.0;
+            cfg.DVel=0.0;
         }
 
-        if (DAcc<0.0)
+        if (cfg.DAcc<0.0)
         {
             cout<<"Warning: thrAcc cannot be lower than 0.0 => D=0.0 is assumed"<<endl;
-            DAcc=0.0;
+            cfg.DAcc=0.0;
+        }
+        
+        if (cfg.decimation<1)
+        {
+            cout<<"Warning: decimation cannot be lower than 1 => decimation=1 is assumed"<<endl;
+            cfg.decimation=1;
         }
         
-        // Input positions
-        port_pos = new dataCollector(NVel,DVel,NAcc,DAcc, &PVABuffer, &PVABufferMutex);
-        port_pos->useCallback();
-        port_pos->open((portName + "/pos:i").c_str());
+        return true;
+    }
+
+public:
+    
+    // rpcPort commands handler
+    bool respond(const Bottle &      command,
+                 Bottle &      reply)
+    {
+        // This method is called when a command string is sent via RPC
 
-        // Input F/T
-        FTport.open((portName + "/ft:i").c_str());
+        // Get command string
+        string receivedCmd = command.get(0).asString().c_str();
+        reply.clear();  // Clear reply bottle
         
-        // RPC
-        rpcPort.open((portName + "/rpc").c_str());
-        attach(rpcPort);
+        if (receivedCmd == "help")
+        {
+            reply.addVocab(Vocab::encode("many"));
+            reply.addString("Available commands are:");
+            reply.addString("help");
+            reply.addString("stats");
+            reply.addString("quit");
+        }
+        else if (receivedCmd == "stats")
+        {
+            aligner.addStats(reply);
+            for (size_t s = 0 ; s < collectors.size() ; ++s)
+                collectors[s]->addStats(reply);
+        }
+        else if (receivedCmd == "quit")
+        {
+            reply.addString("Quitting.");
+            return false; //note also this
+        }
+        else
+            reply.addString("Invalid command, type [help] for a list of accepted commands.");
+
+        return true;
+    }
+    
+    virtual bool configure(ResourceFinder &rf)
+    {
+        // request high resolution scheduling
+        Time::turboBoost();
+
+        string portName=rf.check("name",Value("/Synchronizer")).asString().c_str();
+        int bufLen = rf.check("bufLen", Value(32)).asInt();
+        
+        string overflow=rf.check("overflow",Value("dropOldest")).asString().c_str();
+        outputQueue::overflowPolicy policy;
+        if (!outputQueue::parsePolicy(overflow, policy))
+        {
+            cout<<"Warning: unknown overflow policy "<<overflow<<" => dropOldest is assumed"<<endl;
+            policy=outputQueue::DROP_OLDEST;
+        }
+        
+        int outQueueLen = rf.check("outQueueLen", Value(16)).asInt();
+        if (outQueueLen<1)
+        {
+            cout<<"Warning: outQueueLen cannot be lower than 1 => outQueueLen=1 is assumed"<<endl;
+            outQueueLen=1;
+        }
+        
+        string alignMode=rf.check("alignMode",Value("interpolate")).asString().c_str();
+        if (alignMode != "interpolate" && alignMode != "latest")
+        {
+            cout<<"Warning: unknown alignMode "<<alignMode<<" => interpolate is assumed"<<endl;
+            alignMode="interpolate";
+        }
+        
+        if (bufLen<2)
+        {
+            cout<<"Warning: bufLen cannot be lower than 2 => bufLen=2 is assumed"<<endl;
+            bufLen=2;
+        }
+        
+        // Defaults of the stream settings, from the top level of the configuration
+        streamConfig def;
+        def.derivatives = 0;
+        def.NVel = rf.check("lenVel",Value(16)).asInt();
+        def.NAcc = rf.check("lenAcc",Value(25)).asInt();
+        def.DVel = rf.check("thrVel",Value(1.0)).asDouble();
+        def.DAcc = rf.check("thrAcc",Value(1.0)).asDouble();
+        def.incremental = (rf.check("awMode",Value("maxResidual")).asString() == "incremental");
+        def.decimation = 1;
+        def.cutFreq = 0.0;
+        
+        vector<streamConfig> cfgs;
+        string triggerName;
+        Bottle* streamList = rf.find("streams").asList();
+        if (streamList != 0 && streamList->size() > 0)
+        {
+            // Arbitrary list of streams, each one configured in its own group
+            for (int i = 0 ; i < streamList->size() ; ++i)
+            {
+                def.name = streamList->get(i).asString().c_str();
+                streamConfig cfg;
+                if (!readStreamConfig(rf.findGroup(def.name.c_str()), def, cfg))
+                    return false;
+                cfgs.push_back(cfg);
+            }
+            triggerName = rf.check("trigger", Value(cfgs.back().name.c_str())).asString().c_str();
+        }
+        else
+        {
+            // Single limb: joint positions on pos:i, F/T on ft:i
+            int xsz = rf.check("xsz", Value(4)).asInt();
+            int t = rf.check("t", Value(6)).asInt();
+            streamConfig cfg;
+            
+            def.name = "pos";
+            def.derivatives = 2;
+            for (int i = 0 ; i < xsz ; ++i)
+                def.joints.push_back(i);
+            if (!readStreamConfig(rf, def, cfg))
+                return false;
+            cfgs.push_back(cfg);
+            
+            def = streamConfig();
+            def.name = "ft";
+            def.derivatives = 0;
+            def.NVel = 2;
+            def.NAcc = 3;
+            def.DVel = def.DAcc = 0.0;
+            def.incremental = false;
+            def.decimation = 1;
+            def.cutFreq = 0.0;
+            for (int i = 0 ; i < t ; ++i)
+                def.joints.push_back(i);
+            Bottle empty;
+            if (!readStreamConfig(empty, def, cfg))
+                return false;
+            cfgs.push_back(cfg);
+            
+            triggerName = "ft";
+        }
+        
+        size_t trigger = cfgs.size();
+        vector<size_t> widths;
+        for (size_t s = 0 ; s < cfgs.size() ; ++s)
+        {
+            widths.push_back(cfgs[s].width());
+            if (cfgs[s].name == triggerName)
+                trigger = s;
+        }
+        if (trigger == cfgs.size())
+        {
+            cout<<"Error: trigger stream "<<triggerName<<" not found"<<endl;
+            return false;
+        }
+        
+        // Realtime options: the output writer is worker 0, the callback of stream s is worker s+1
+        rtConfig::settings rt = rtConfig::read(rf);
+        rtConfig::configureProcess(rt);
+        aligner.setRealtime(rt);
         
         // Output Vector
         outPort.open((portName + "/vec:o").c_str());
+        aligner.configure(&outPort, widths, trigger, bufLen, alignMode == "latest", policy, outQueueLen);
+        
+        // Input streams
+        for (size_t s = 0 ; s < cfgs.size() ; ++s)
+        {
+            cout<<"Stream "<<cfgs[s].name<<": "<<cfgs[s].joints.size()<<" elements, "<<cfgs[s].derivatives
+                <<" derivatives, decimation "<<cfgs[s].decimation<<(s == trigger ? " (trigger)" : "")<<endl;
+            streamCollector* c = new streamCollector(s, cfgs[s], &aligner, rt);
+            c->useCallback();
+            c->open((portName + cfgs[s].port).c_str());
+            collectors.push_back(c);
+        }
+        cout<<"Output size: "<<aligner.getOutputSize()<<endl;
+        
+        // RPC
+        rpcPort.open((portName + "/rpc").c_str());
+        attach(rpcPort);
 
         return true;
     }
 
     virtual bool close()
     {
-        port_pos->close();
-        FTport.close();
+        for (size_t s = 0 ; s < collectors.size() ; ++s)
+            collectors[s]->close();
+        aligner.stopOutput();
         outPort.close();
         rpcPort.close();
 
-        delete port_pos;
-        delete FTVector;
+        for (size_t s = 0 ; s < collectors.size() ; ++s)
+            delete collectors[s];
+        collectors.clear();
 
         return true;
     }
     
     bool interruptModule()
     {
-        port_pos->interrupt();
-        FTport.interrupt();
+        for (size_t s = 0 ; s < collectors.size() ; ++s)
+            collectors[s]->interrupt();
         outPort.interrupt();
         rpcPort.interrupt();
-        
-        PVABufferMutex.unlock(); // Unlock the mutex to avoid deadlocks and allow a smooth stop
-
 
         return true;
     }    
 
-    virtual double getPeriod()    { return 0.05;  }
+    size_t getNumStreams() const                        { return collectors.size(); }
+    const streamConfig & getStreamConfig(size_t s) const { return collectors[s]->getConfig(); }
+    bool isTrigger(size_t s)                            { return aligner.getTrigger() == s; }
+
+    // The output is written from the port callbacks, updateModule only keeps the module alive
+    virtual double getPeriod()    { return 1.0;  }
     
     virtual bool   updateModule() {
-        
-        cout << "updateModule " << endl;
-        Vector& res = outPort.prepare();
-        res.clear();
-        res.resize(3*xsz + t);
-        
-        // Protect ON
-        PVABufferMutex.lock();
-        res.setSubvector( 0 , PVABuffer );
-        PVABufferMutex.unlock();
-        // Protect OFF
-        
-        // Read the most recent F/T        
-        Bottle* b = FTport.read();
-        for (int i = 0 ; i < b->size() ; i++) {
-            (*FTVector)[i] = b->get(i).asDouble();
+        return true; 
+    }
+};
+
+/************************************************************************************************/
+// Loopback replay, used to measure the achievable output rate and the CPU use.
+// Synthetic samples are written to the input ports at the requested rates and the output is read back.
+
+// Writes synthetic samples of one stream at a fixed rate, stamped in the envelope
+class replayWriter : public Thread
+{
+private:
+    BufferedPort<Bottle>  port;
+    string                name;
+    string                target;
+    size_t                size;         // Number of elements of each sample
+    double                rate;         // Requested rate [Hz]
+    long unsigned int     sent;
+
+public:
+    replayWriter(const string &_name, const string &_target, size_t _size, double _rate)
+        : name(_name), target(_target), size(_size), rate(_rate), sent(0)
+    {
+    }
+    
+    bool openAndConnect()
+    {
+        port.open(name.c_str());
+        return Network::connect(name.c_str(), target.c_str());
+    }
+    
+    virtual void run()
+    {
+        double period = 1.0 / rate;
+        double next = Time::now();
+        while (!isStopping())
+        {
+            double now = Time::now();
+            Bottle &b = port.prepare();
+            b.clear();
+            for (size_t i = 0 ; i < size ; ++i)
+                b.addDouble(sin(M_PI * now + i));
+            Stamp info(sent, now);
+            port.setEnvelope(info);
+            port.write();
+            ++sent;
+            
+            // Keep the requested rate, without bursts when late
+            next += period;
+            double wait = next - Time::now();
+            if (wait > 0.0)
+                Time::delay(wait);
+            else
+                next = Time::now();
         }
+    }
+    
+    void closePort()
+    {
+        port.interrupt();
+        port.close();
+    }
+    
+    long unsigned int getSent() const   { return sent; }
+};
+
+// Counts the output samples and measures their delay with respect to the trigger time stamp
+class replayReader : public BufferedPort<Vector>
+{
+private:
+    Mutex               mutex;
+    long unsigned int   received;
+    double              latencySum;
+    double              maxLatency;
+    
+    virtual void onRead(Vector &v)
+    {
+        Stamp info;
+        BufferedPort<Vector>::getEnvelope(info);
+        double latency = Time::now() - info.getTime();
         
-        if (FTVector==0)
+        mutex.lock();
+        ++received;
+        latencySum += latency;
+        if (latency > maxLatency)
+            maxLatency = latency;
+        mutex.unlock();
+    }
+
+public:
+    replayReader() : received(0), latencySum(0.0), maxLatency(0.0)
+    {
+    }
+    
+    void getStats(long unsigned int &n, double &meanLatency, double &maxLat)
+    {
+        mutex.lock();
+        n = received;
+        meanLatency = (received > 0) ? latencySum / received : 0.0;
+        maxLat = maxLatency;
+        mutex.unlock();
+    }
+};
+
+// Replays synthetic data on all the configured streams for replayDuration seconds, the trigger stream at
+// replayTriggerRate and the other ones at replayRate, then prints the output rate, the delay and the CPU use
+int runReplay(ResourceFinder &rf)
+{
+    string portName = rf.check("name",Value("/Synchronizer")).asString().c_str();
+    double duration = rf.check("replayDuration", Value(10.0)).asDouble();
+    double triggerRate = rf.check("replayTriggerRate", Value(500.0)).asDouble();
+    double rate = rf.check("replayRate", Value(100.0)).asDouble();
+    
+    Synchronizer sync;
+    if (!sync.configure(rf))
+        return -1;
+    
+    replayReader reader;
+    reader.useCallback();
+    reader.open((portName + "/replay/vec:i").c_str());
+    Network::connect((portName + "/vec:o").c_str(), (portName + "/replay/vec:i").c_str());
+    
+    vector<replayWriter*> writers;
+    for (size_t s = 0 ; s < sync.getNumStreams() ; ++s)
+    {
+        const streamConfig &cfg = sync.getStreamConfig(s);
+        int size = 0;
+        for (size_t i = 0 ; i < cfg.joints.size() ; ++i)
+            if (cfg.joints[i] + 1 > size)
+                size = cfg.joints[i] + 1;
+        writers.push_back(new replayWriter(portName + "/replay/" + cfg.name + ":o", portName + cfg.port,
+                                           size, sync.isTrigger(s) ? triggerRate : rate));
+        if (!writers.back()->openAndConnect())
+            cout<<"Warning: cannot connect the replay of stream "<<cfg.name<<endl;
+    }
+    
+    cout<<"Replaying for "<<duration<<" s: trigger at "<<triggerRate<<" Hz, other streams at "<<rate<<" Hz"<<endl;
+    clock_t c0 = clock();
+    double t0 = Time::now();
+    for (size_t s = 0 ; s < writers.size() ; ++s)
+        writers[s]->start();
+    Time::delay(duration);
+    for (size_t s = 0 ; s < writers.size() ; ++s)
+        writers[s]->stop();
+    double elapsed = Time::now() - t0;
+    double cpu = (double)(clock() - c0) / CLOCKS_PER_SEC;
+    
+    // Let the last samples through
+    Time::delay(0.1);
+    
+    long unsigned int received;
+    double meanLatency, maxLatency;
+    reader.getStats(received, meanLatency, maxLatency);
+    
+    cout<<fixed<<setprecision(3);
+    for (size_t s = 0 ; s < writers.size() ; ++s)
+        cout<<"Stream "<<sync.getStreamConfig(s).name<<": "<<writers[s]->getSent()<<" samples sent, "
+            <<writers[s]->getSent() / elapsed<<" Hz"<<endl;
+    cout<<"Output: "<<received<<" samples, "<<received / elapsed<<" Hz"<<endl;
+    cout<<"Delay from the trigger time stamp: mean "<<1000.0 * meanLatency<<" ms, max "<<1000.0 * maxLatency<<" ms"<<endl;
+    cout<<"CPU use of the process (writers and reader included): "<<100.0 * cpu / elapsed<<" %"<<endl;
+    
+    Bottle cmd, reply;
+    cmd.addString("stats");
+    sync.respond(cmd, reply);
+    cout<<"Synchronizer stats: "<<reply.toString().c_str()<<endl;
+    
+    for (size_t s = 0 ; s < writers.size() ; ++s)
+    {
+        writers[s]->closePort();
+        delete writers[s];
+    }
+    reader.interrupt();
+    reader.close();
+    sync.interruptModule();
+    sync.close();
+    
+    return 0;
+}
+
+
+/************************************************************************/
+// Latency of one hop between two ports of this process: YARP tcp, YARP shmem carrier, shared memory channel
+
+// Records the delay of each received message with respect to the time stamp in its envelope
+class latencyReader : public BufferedPort<Vector>
+{
+private:
+    Mutex           mutex;
+    vector<double>  latencies;
+    
+    virtual void onRead(Vector &v)
+    {
+        Stamp info;
+        BufferedPort<Vector>::getEnvelope(info);
+        double latency = Time::now() - info.getTime();
+        mutex.lock();
+        latencies.push_back(latency);
+        mutex.unlock();
+    }
+
+public:
+    void getLatencies(vector<double> &l)
+    {
+        mutex.lock();
+        l = latencies;
+        mutex.unlock();
+    }
+};
+
+// Reads the shared memory channel in its own thread, as a consumer module would
+class shmLatencyReader : public Thread
+{
+private:
+    shmChannel::reader  channel;
+    vector<double>      latencies;
+    vector<double>      buf;
+    
+public:
+    bool open(const string &portName, unsigned int maxSize)
+    {
+        return channel.open(portName, 64, maxSize);
+    }
+    
+    virtual void run()
+    {
+        double stamp;
+        while (!isStopping())
+            if (channel.read(stamp, buf))
+                latencies.push_back(Time::now() - stamp);
+    }
+    
+    virtual void onStop()
+    {
+        channel.interrupt();
+    }
+    
+    const vector<double> & getLatencies() const { return latencies; }
+};
+
+void printLatencies(const string &transport, vector<double> l, int sent)
+{
+    if (l.empty())
+    {
+        printf("%-10s %8d %8d %10s %10s %10s %10s\n", transport.c_str(), sent, 0, "-", "-", "-", "-");
+        return;
+    }
+    sort(l.begin(), l.end());
+    double mean = 0.0;
+    for (size_t i = 0 ; i < l.size() ; ++i)
+        mean += l[i];
+    mean /= l.size();
+    printf("%-10s %8d %8d %10.1f %10.1f %10.1f %10.1f\n", transport.c_str(), sent, (int)l.size(), 1e6 * mean,
+           1e6 * l[l.size() / 2], 1e6 * l[(l.size() * 99) / 100], 1e6 * l.back());
+}
+
+// Sends benchN messages of benchSize doubles, one every benchPeriod seconds, on each transport
+int runTransportBenchmark(ResourceFinder &rf)
+{
+    int benchN = rf.check("benchN", Value(5000)).asInt();
+    int benchSize = rf.check("benchSize", Value(18)).asInt();
+    double benchPeriod = rf.check("benchPeriod", Value(0.001)).asDouble();
+    string prefix = "/SynchronizerTransportBench";
+    
+    printf("One-hop latency [us], %d messages of %d doubles every %g s\n", benchN, benchSize, benchPeriod);
+    printf("%-10s %8s %8s %10s %10s %10s %10s\n", "transport", "sent", "recv", "mean", "median", "99%", "max");
+    
+    const char* carriers[] = { "tcp", "shmem" };
+    for (int c = 0 ; c < 2 ; ++c)
+    {
+        BufferedPort<Vector> out;
+        latencyReader in;
+        in.useCallback();
+        out.open((prefix + "/" + carriers[c] + ":o").c_str());
+        in.open((prefix + "/" + carriers[c] + ":i").c_str());
+        int sent = 0;
+        if (Network::connect(out.getName().c_str(), in.getName().c_str(), carriers[c]))
         {
-            // Skipping...
-            return true;
+            Time::delay(0.5);
+            for (int k = 0 ; k < benchN ; ++k)
+            {
+                Vector &v = out.prepare();
+                v.resize(benchSize, (double)k);
+                Stamp info(k, Time::now());
+                out.setEnvelope(info);
+                out.writeStrict();
+                ++sent;
+                Time::delay(benchPeriod);
+            }
+            Time::delay(0.5);
         }
-        
-        res.setSubvector( 3*xsz , *FTVector );   // WARNING: FTVector must be the most recent reading of the F/T sensor. How to get it in this callback?
+        vector<double> l;
+        in.getLatencies(l);
+        printLatencies(carriers[c], l, sent);
+        in.interrupt();
+        in.close();
+        out.interrupt();
+        out.close();
+    }
+    
+    // Shared memory channel
+    {
+        string portName = prefix + "/shm:o";
+        shmLatencyReader in;
+        shmChannel::writer out;
+        vector<double> v(benchSize);
+        int sent = 0;
+        if (in.open(portName, benchSize))
+        {
+            in.start();
+            out.open(portName);
+            for (int k = 0 ; k < benchN ; ++k)
+            {
+                for (int i = 0 ; i < benchSize ; ++i)
+                    v[i] = k;
+                if (out.write(Time::now(), &v[0], benchSize))
+                    ++sent;
+                Time::delay(benchPeriod);
+            }
+            Time::delay(0.5);
+            in.stop();
+        }
+        printLatencies("shmChannel", in.getLatencies(), sent);
+    }
+    
+    return 0;
+}
+
 
-        // the outbound packets will carry the same
-        // envelope information of the inbound ones.
-        if (outPort.getOutputCount()>0)
+
+/************************************************************************/
+// Replays a trajectory through awPolyEstimator and through the ctrlLib AWLinEstimator and AWQuadEstimator
+// with the same lenVel, thrVel, lenAcc and thrAcc, and reports the deviation of the velocity and
+// acceleration estimates. The trajectory is read from the file given to awCompare, one sample per line as
+// [ t x1 ... xn ]; without a file a noisy multi-sine trajectory is generated. The first max(lenVel, lenAcc)
+// samples, while the windows fill up, are not compared.
+int runAwCompare(ResourceFinder &rf)
+{
+#ifndef SYNCHRONIZER_HAS_CTRLLIB
+    cout<<"Error: the Synchronizer was built without ctrlLib, which is needed by awCompare"<<endl;
+    return -1;
+#else
+    unsigned int NVel = rf.check("lenVel",Value(16)).asInt();
+    unsigned int NAcc = rf.check("lenAcc",Value(25)).asInt();
+    double DVel = rf.check("thrVel",Value(1.0)).asDouble();
+    double DAcc = rf.check("thrAcc",Value(1.0)).asDouble();
+    double tol = rf.check("awTol",Value(1e-6)).asDouble();
+    if (NVel < 2 || NAcc < 3 || DVel < 0.0 || DAcc < 0.0)
+    {
+        cout<<"Error: inconsistent adaptive window parameters!"<<endl;
+        return -1;
+    }
+    
+    // Trajectory
+    vector<double> times;
+    vector< vector<double> > samples;
+    string fileName = rf.find("awCompare").asString().c_str();
+    if (!fileName.empty())
+    {
+        ifstream in(fileName.c_str());
+        if (!in.is_open())
         {
-            //outPort.setEnvelope(info);        // WARNING: missing info. To be implemented
-            outPort.write();
+            cout<<"Error: cannot open "<<fileName<<endl;
+            return -1;
         }
-        else
-            outPort.unprepare();        
+        string line;
+        while (getline(in, line))
+        {
+            istringstream ss(line);
+            double t, v;
+            if (!(ss >> t))
+                continue;
+            vector<double> x;
+            while (ss >> v)
+                x.push_back(v);
+            if (x.empty() || (!samples.empty() && x.size() != samples[0].size()))
+                continue;
+            times.push_back(t);
+            samples.push_back(x);
+        }
+        cout<<"Replaying "<<samples.size()<<" samples of "<<fileName<<endl;
+    }
+    else
+    {
+        int n = rf.check("awSamples",Value(5000)).asInt();
+        mt19937 rng(1);
+        normal_distribution<double> noise(0.0, 0.05);
+        uniform_real_distribution<double> jitter(-0.001, 0.001);
+        for (int k = 0 ; k < n ; ++k)
+        {
+            double t = 0.01 * k + jitter(rng);
+            vector<double> x(6);
+            for (size_t i = 0 ; i < x.size() ; ++i)
+                x[i] = 30.0 * sin(2.0 * M_PI * (0.2 + 0.15 * i) * t) + noise(rng);
+            times.push_back(t);
+            samples.push_back(x);
+        }
+        cout<<"Replaying "<<n<<" samples of a synthetic trajectory"<<endl;
+    }
+    if (samples.empty())
+    {
+        cout<<"Error: empty trajectory"<<endl;
+        return -1;
+    }
+    size_t dim = samples[0].size();
+    
+    awPolyEstimator lin, quad;
+    lin.configure(1, NVel, DVel, dim);
+    quad.configure(2, NAcc, DAcc, dim);
+    AWLinEstimator refLin(NVel, DVel);
+    AWQuadEstimator refQuad(NAcc, DAcc);
+    
+    vector<double> vel(dim), acc(dim);
+    double maxDevVel = 0.0, maxDevAcc = 0.0, maxVel = 0.0, maxAcc = 0.0;
+    size_t skip = (NVel > NAcc) ? NVel : NAcc;
+    for (size_t k = 0 ; k < samples.size() ; ++k)
+    {
+        lin.estimate(times[k], &samples[k][0], &vel[0]);
+        quad.estimate(times[k], &samples[k][0], &acc[0]);
         
-        return true; 
+        Vector x(dim);
+        for (size_t i = 0 ; i < dim ; ++i)
+            x[i] = samples[k][i];
+        AWPolyElement el(x, times[k]);
+        Vector refVel = refLin.estimate(el);
+        Vector refAcc = refQuad.estimate(el);
+        
+        if (k < skip)
+            continue;
+        for (size_t i = 0 ; i < dim ; ++i)
+        {
+            maxDevVel = max(maxDevVel, fabs(vel[i] - refVel[i]));
+            maxDevAcc = max(maxDevAcc, fabs(acc[i] - refAcc[i]));
+            maxVel = max(maxVel, fabs(refVel[i]));
+            maxAcc = max(maxAcc, fabs(refAcc[i]));
+        }
+    }
+    
+    double relVel = (maxVel > 0.0) ? maxDevVel / maxVel : maxDevVel;
+    double relAcc = (maxAcc > 0.0) ? maxDevAcc / maxAcc : maxDevAcc;
+    cout<<"Velocity:     max deviation "<<maxDevVel<<" ("<<relVel<<" of the largest ctrlLib estimate)"<<endl;
+    cout<<"Acceleration: max deviation "<<maxDevAcc<<" ("<<relAcc<<" of the largest ctrlLib estimate)"<<endl;
+    bool ok = (relVel <= tol && relAcc <= tol);
+    cout<<(ok ? "Within" : "NOT within")<<" the tolerance of "<<tol<<endl;
+    return ok ? 0 : -1;
+#endif
+}
+
+/************************************************************************/
+// Seqlock stress test: a writer thread pushes samples whose elements and time stamp all equal the sample
+// index, as fast as it can, into a small seqlockRing; the reader copies in a tight loop the newest sample,
+// the oldest one, whose slot is the next to be overwritten, and the next expected one. A snapshot returned
+// as valid is torn if any element differs from its index.
+class seqlockStressWriter : public Thread
+{
+private:
+    seqlockRing*          ring;
+    size_t                width;
+    vector<double>        sample;
+    
+public:
+    unsigned long int     pushed;
+    
+    seqlockStressWriter(seqlockRing* _ring, size_t _width) : ring(_ring), width(_width), sample(_width), pushed(0)
+    {
+    }
+    
+    virtual void run()
+    {
+        while (!isStopping())
+        {
+            for (size_t i = 0 ; i < width ; ++i)
+                sample[i] = (double)pushed;
+            ring->push((double)pushed, &sample[0]);
+            ++pushed;
+        }
     }
 };
 
+int runSeqlockStress(ResourceFinder &rf)
+{
+    double duration = rf.check("stressDuration", Value(5.0)).asDouble();
+    int width = rf.check("benchSize", Value(18)).asInt();
+    int capacity = rf.check("stressBufLen", Value(4)).asInt();
+    if (duration <= 0.0 || width < 1 || capacity < 1)
+    {
+        cout<<"Error: inconsistent seqlock stress parameters!"<<endl;
+        return -1;
+    }
+    
+    seqlockRing ring;
+    ring.resize(capacity, width);
+    seqlockStressWriter writer(&ring, width);
+    vector<double> dst(width);
+    unsigned long int reads = 0, valid = 0, overwritten = 0, torn = 0;
+    unsigned long int next = 0;
+    
+    cout<<"Seqlock stress test: "<<duration<<" s, "<<capacity<<" slots of "<<width<<" doubles"<<endl;
+    writer.start();
+    double t0 = Time::now();
+    while (Time::now() - t0 < duration)
+    {
+        for (int k = 0 ; k < 1000 ; ++k)
+        {
+            unsigned long int published = ring.getPublished();
+            if (published == 0)
+                continue;
+            
+            // Cycle over the newest sample, the oldest one (being overwritten) and the next expected one
+            unsigned long int idx;
+            if (k % 3 == 0)
+                idx = published - 1;
+            else if (k % 3 == 1 && published >= (unsigned long int)capacity)
+                idx = published - capacity;
+            else
+                idx = next;
+            double stamp;
+            ++reads;
+            if (!ring.read(idx, stamp, &dst[0]))
+            {
+                ++overwritten;
+                if (idx == next)
+                    next = published - 1;
+                continue;
+            }
+            ++valid;
+            bool ok = (stamp == (double)idx);
+            for (int i = 0 ; i < width ; ++i)
+                ok = ok && (dst[i] == (double)idx);
+            if (!ok)
+            {
+                if (torn == 0)
+                    cout<<"Torn snapshot of sample "<<idx<<": stamp "<<stamp<<", elements "<<dst[0]<<" ... "<<dst[width-1]<<endl;
+                ++torn;
+            }
+            if (idx == next && next < published)
+                ++next;
+        }
+    }
+    writer.stop();
+    
+    cout<<"Samples written: "<<writer.pushed<<endl;
+    cout<<"Reads: "<<reads<<" ("<<valid<<" valid, "<<overwritten<<" already overwritten)"<<endl;
+    cout<<"Torn snapshots: "<<torn<<endl;
+    return (torn == 0 && valid > 0) ? 0 : -1;
+}
+
 
 
 int main(int argc, char *argv[])
@@ -272,10 +1960,40 @@ int main(int argc, char *argv[])
         cout<<"\t--thrVel    D: velocity max deviation threshold (default: 1.0)"    <<endl;
         cout<<"\t--lenAcc    N: acceleration window's max length (default: 25)"     <<endl;
         cout<<"\t--thrAcc    D: acceleration max deviation threshold (default: 1.0)"<<endl;
+        cout<<"\t--awMode    M: adaptive window test, maxResidual or incremental (RMS, O(N)) (default: maxResidual)"<<endl;
+        cout<<"\t--joints (i1 i2 ...): indices of the joints to consider (default: the first xsz)"<<endl;
+        cout<<"\t--decimation N: forward one position sample every N (default: 1)"<<endl;
+        cout<<"\t--cutFreq   F: cut frequency [Hz] of the anti-aliasing filter, 0 to disable (default: 0)"<<endl;
+        cout<<"\t--bufLen    N: length of the stream ring buffers (default: 32)"<<endl;
+        cout<<"\t--streams (s1 s2 ...): input streams, each configured in its group [s1] with"<<endl;
+        cout<<"\t             joints, derivatives (0, 1 or 2), port and the settings above"<<endl;
+        cout<<"\t--trigger   s: stream whose time stamps drive the output (default: the last one)"<<endl;
+        cout<<"\t--alignMode M: interpolate (wait for the other streams to cover the trigger stamp) or"<<endl;
+        cout<<"\t             latest (emit on each trigger sample with the latest samples) (default: interpolate)"<<endl;
+        cout<<"\t--overflow  P: output overflow policy: dropOldest, dropNewest or block (default: dropOldest)"<<endl;
+        cout<<"\t--outQueueLen N: samples queued while the consumers are busy (default: 16)"<<endl;
+        cout<<"\t--rtCpu (c0 c1 ...): cores of the output writer and of the stream callbacks, in this order"<<endl;
+        cout<<"\t--rtPriority P: SCHED_FIFO priority of the same threads, 0 to disable (default: 0)"<<endl;
+        cout<<"\t--rtLockMemory 1, --rtPrefault KB: lock the memory and prefault heap and stacks (default: 0, 0)"<<endl;
+        cout<<"\t--replay      : replay synthetic data on the configured ports and print the output rate and CPU use"<<endl;
+        cout<<"\t--transportBenchmark: one-hop latency of YARP tcp, YARP shmem and the shared memory channel"<<endl;
+        cout<<"\t             (--benchN N, --benchSize S, --benchPeriod T; default: 5000, 18, 0.001 s)"<<endl;
+        cout<<"\t--replayDuration T, --replayTriggerRate F, --replayRate F: replay settings (default: 10 s, 500 Hz, 100 Hz)"<<endl;
+        cout<<"\t--awCompare [file]: replay a trajectory ([ t x1 ... xn ] per line, synthetic without a file) through"<<endl;
+        cout<<"\t             the adaptive window estimators and through ctrlLib and print the maximum deviation"<<endl;
+        cout<<"\t             (--awTol T, --awSamples N; default: 1e-6 relative, 5000) (requires ctrlLib)"<<endl;
+        cout<<"\t--seqlockStress: one writer and one reader thread on a stream ring buffer, checking that no"<<endl;
+        cout<<"\t             snapshot is torn (--stressDuration T, --benchSize S, --stressBufLen N; default: 5 s, 18, 4)"<<endl;
 
         return 0;
     }
 
+    // The stress test and the estimator comparison do not need the YARP network
+    if (rf.check("seqlockStress"))
+        return runSeqlockStress(rf);
+    if (rf.check("awCompare"))
+        return runAwCompare(rf);
+
     Network yarp;
     if (!yarp.checkNetwork())
     {
@@ -283,6 +2001,12 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (rf.check("replay"))
+        return runReplay(rf);
+    
+    if (rf.check("transportBenchmark"))
+        return runTransportBenchmark(rf);
+
     Synchronizer sync;
     return sync.runModule(rf);
 }
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _RT_CONFIG
+#define _RT_CONFIG
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+
+#include <yarp/os/Searchable.h>
+#include <yarp/os/Value.h>
+#include <yarp/os/Bottle.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/** Realtime configuration of the worker threads of the modules.
+ *
+ * The same options are accepted by all the modules, from the configuration file or from the command line:
+ * - rtCpu: core (or list of cores) the worker threads are pinned to. The i-th worker thread of a module
+ *   takes the (i mod n)-th core of the list.
+ * - rtPriority: SCHED_FIFO priority of the worker threads (1..99, 0 keeps the default scheduling). If the
+ *   process is not permitted to use it (CAP_SYS_NICE or an rtprio limit are needed) a warning is printed
+ *   and the thread keeps running with the default policy.
+ * - rtLockMemory: lock the current and future pages of the process in memory with mlockall, and stop
+ *   the allocator from returning memory to the system, so that no page fault happens in the loop.
+ * - rtPrefault: size [KB] of the heap reserve and of the stack of each worker thread which are touched
+ *   in advance.
+ *
+ * Only Linux is supported; elsewhere the options are ignored with a warning.
+ */
+namespace rtConfig
+{
+
+/** Realtime options shared by the worker threads of a module. */
+struct settings
+{
+    std::vector<int>    cpus;           ///< Cores the worker threads are pinned to (empty: no pinning)
+    int                 priority;       ///< SCHED_FIFO priority (0: default scheduling)
+    bool                lockMemory;     ///< Lock the memory of the process
+    int                 prefaultKB;     ///< Heap reserve and stack touched in advance [KB]
+
+    settings() : priority(0), lockMemory(false), prefaultKB(0)
+    {
+    }
+
+    /** @return True if at least one option is set. */
+    bool enabled() const
+    {
+        return !cpus.empty() || priority > 0 || lockMemory || prefaultKB > 0;
+    }
+};
+
+/** Reads the realtime options (rtCpu, rtPriority, rtLockMemory, rtPrefault). */
+inline settings read(yarp::os::Searchable &config)
+{
+    settings s;
+    if (config.check("rtCpu"))
+    {
+        yarp::os::Value &v = config.find("rtCpu");
+        if (v.isList())
+        {
+            for (int i = 0 ; i < v.asList()->size() ; ++i)
+                s.cpus.push_back(v.asList()->get(i).asInt());
+        }
+        else
+            s.cpus.push_back(v.asInt());
+    }
+    s.priority = config.check("rtPriority",yarp::os::Value(0)).asInt();
+    s.lockMemory = config.check("rtLockMemory",yarp::os::Value(0)).asInt() != 0;
+    s.prefaultKB = config.check("rtPrefault",yarp::os::Value(s.lockMemory ? 512 : 0)).asInt();
+    if (s.priority < 0 || s.priority > 99)
+    {
+        printf("Warning: rtPriority must be in [0,99] => 0 (default scheduling) is assumed\n");
+        s.priority = 0;
+    }
+    return s;
+}
+
+/** Touches kb KB of the stack of the calling thread, so that the pages are mapped before the loop runs. */
+inline void prefaultStack(int kb)
+{
+    if (kb <= 0)
+        return;
+    volatile unsigned char buf[16*1024];
+    for (size_t i = 0 ; i < sizeof(buf) ; i += 4096)
+        buf[i] = 0;
+    prefaultStack(kb - 16);
+    buf[0] = buf[sizeof(buf)-1];    // keeps the frame alive across the recursive call
+}
+
+/** Touches all the pages of a preallocated buffer. */
+inline void prefault(void *ptr, size_t bytes)
+{
+    volatile unsigned char *p = (volatile unsigned char*)ptr;
+    for (size_t i = 0 ; i < bytes ; i += 4096)
+        p[i] = p[i];
+    if (bytes > 0)
+        p[bytes-1] = p[bytes-1];
+}
+
+/** Process-wide part of the configuration: memory locking and heap reserve. Call once, from any thread.
+ * @return False if some option could not be applied. */
+inline bool configureProcess(const settings &s)
+{
+    bool ok = true;
+#if defined(__linux__)
+    if (s.lockMemory)
+    {
+        // Freed memory stays in the process, and large blocks come from the (locked) heap
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            printf("Warning: mlockall failed (%s) => memory is not locked\n", strerror(errno));
+            ok = false;
+        }
+    }
+    if (s.prefaultKB > 0)
+    {
+        // Heap reserve: with trimming disabled the touched pages are reused by the next allocations
+        size_t bytes = (size_t)s.prefaultKB * 1024;
+        void *reserve = malloc(bytes);
+        if (reserve != 0)
+        {
+            memset(reserve, 0, bytes);
+            free(reserve);
+        }
+    }
+#else
+    if (s.lockMemory || s.prefaultKB > 0)
+    {
+        printf("Warning: memory locking is only supported on Linux => option ignored\n");
+        ok = false;
+    }
+#endif
+    return ok;
+}
+
+/** Per-thread part of the configuration: core affinity, SCHED_FIFO priority and stack prefaulting.
+ * Must be called by the thread to be configured.
+ * @param s The realtime options.
+ * @param index Index of the worker thread within the module, used to pick its core.
+ * @param label Name of the thread, for the log.
+ * @return False if some option could not be applied. */
+inline bool configureThread(const settings &s, size_t index = 0, const std::string &label = "worker")
+{
+    if (!s.enabled())
+        return true;
+
+    bool ok = true;
+#if defined(__linux__)
+    if (!s.cpus.empty())
+    {
+        int cpu = s.cpus[index % s.cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            printf("Warning: cannot pin the %s thread to core %d (%s) => no affinity is set\n", label.c_str(), cpu, strerror(err));
+            ok = false;
+        }
+        else
+            printf("%s thread pinned to core %d\n", label.c_str(), cpu);
+    }
+
+    if (s.priority > 0)
+    {
+        sched_param param;
+        param.sched_priority = s.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0)
+        {
+            printf("Warning: SCHED_FIFO priority %d not permitted for the %s thread (%s) => default scheduling is kept\n",
+                   s.priority, label.c_str(), strerror(err));
+            ok = false;
+        }
+        else
+            printf("%s thread running with SCHED_FIFO priority %d\n", label.c_str(), s.priority);
+    }
+
+    prefaultStack(s.prefaultKB);
+#else
+    printf("Warning: realtime options are only supported on Linux => ignored for the %s thread\n", label.c_str());
+    ok = false;
+#endif
+    return ok;
+}
+
+/** Histogram of latencies with 1 us bins up to a maximum, plus an overflow bin.
+ * Recording a sample does not allocate memory. */
+class jitterHistogram
+{
+private:
+    std::vector<unsigned long>  bins;       // Samples per microsecond, the last bin collects the overflow
+    unsigned long               count;
+    double                      sum;        // [us]
+    double                      sumSq;      // [us^2]
+    double                      minUs;
+    double                      maxUs;
+
+public:
+    /** @param rangeUs Range of the histogram [us]; larger samples are counted in the overflow bin. */
+    jitterHistogram(size_t rangeUs = 2000) : bins(rangeUs + 1, 0)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (size_t i = 0 ; i < bins.size() ; ++i)
+            bins[i] = 0;
+        count = 0;
+        sum = 0.0;
+        sumSq = 0.0;
+        minUs = 0.0;
+        maxUs = 0.0;
+    }
+
+    /** Records one sample.
+     * @param seconds The latency [s]. */
+    void record(double seconds)
+    {
+        double us = 1e6 * seconds;
+        if (us < 0.0)
+            us = 0.0;
+        size_t b = (size_t)us;
+        if (b >= bins.size())
+            b = bins.size() - 1;
+        ++bins[b];
+        if (count == 0 || us < minUs)
+            minUs = us;
+        if (count == 0 || us > maxUs)
+            maxUs = us;
+        sum += us;
+        sumSq += us * us;
+        ++count;
+    }
+
+    unsigned long getCount() const  { return count; }
+    double getMax() const           { return maxUs; }
+    double getMean() const          { return count > 0 ? sum / count : 0.0; }
+
+    double getStd() const
+    {
+        if (count < 2)
+            return 0.0;
+        double m = getMean();
+        double v = sumSq / count - m * m;
+        return v > 0.0 ? sqrt(v) : 0.0;
+    }
+
+    /** @return The p-th percentile (p in [0,1]) [us], with a resolution of one bin. */
+    double percentile(double p) const
+    {
+        if (count == 0)
+            return 0.0;
+        unsigned long target = (unsigned long)ceil(p * count);
+        if (target < 1)
+            target = 1;
+        unsigned long acc = 0;
+        for (size_t i = 0 ; i < bins.size() ; ++i)
+        {
+            acc += bins[i];
+            if (acc >= target)
+                return (i == bins.size() - 1) ? maxUs : (double)(i + 1);
+        }
+        return maxUs;
+    }
+
+    /** Appends ( label count n mean_us m std_us s p50_us a p99_us b p999_us c max_us d ) to a bottle. */
+    void addStats(yarp::os::Bottle &reply, const std::string &label) const
+    {
+        yarp::os::Bottle &s = reply.addList();
+        s.addString(label.c_str());
+        s.addString("count");
+        s.addInt((int)count);
+        s.addString("mean_us");
+        s.addDouble(getMean());
+        s.addString("std_us");
+        s.addDouble(getStd());
+        s.addString("p50_us");
+        s.addDouble(percentile(0.5));
+        s.addString("p99_us");
+        s.addDouble(percentile(0.99));
+        s.addString("p999_us");
+        s.addDouble(percentile(0.999));
+        s.addString("max_us");
+        s.addDouble(maxUs);
+    }
+
+    /** Prints the summary and the histogram, with the bins grouped in octaves [2^k, 2^(k+1)) us. */
+    void print(const std::string &label) const
+    {
+        printf("%s: %lu samples, mean %.1f us, std %.1f us, p50 %.0f us, p99 %.0f us, p99.9 %.0f us, max %.1f us\n",
+               label.c_str(), count, getMean(), getStd(), percentile(0.5), percentile(0.99), percentile(0.999), maxUs);
+        if (count == 0)
+            return;
+        size_t lo = 0;
+        size_t hi = 1;
+        while (lo < bins.size())
+        {
+            unsigned long n = 0;
+            for (size_t i = lo ; i < hi && i < bins.size() ; ++i)
+                n += bins[i];
+            if (n > 0)
+            {
+                int bar = (int)(50.0 * n / count + 0.5);
+                if (hi >= bins.size())
+                    printf("  %6lu+      us %10lu %s\n", (unsigned long)lo, n, std::string(bar, '#').c_str());
+                else
+                    printf("  %6lu-%-6lu us %10lu %s\n", (unsigned long)lo, (unsigned long)hi, n, std::string(bar, '#').c_str());
+            }
+            lo = hi;
+            hi *= 2;
+            if (hi > bins.size() - 1 && lo < bins.size() - 1)
+                hi = bins.size() - 1;
+            else if (lo == bins.size() - 1)
+                hi = bins.size();
+        }
+    }
+};
+
+}
+
+#endif
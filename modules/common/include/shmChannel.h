@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2014 iCub Facility - Istituto Italiano di Tecnologia
+ * Author: Raffaello Camoriano
+ * email: raffaello.camoriano@iit.it
+ * website: www.robotcub.org
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef _SHM_CHANNEL
+#define _SHM_CHANNEL
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+/** Shared-memory channel carrying timestamped vectors of doubles between two modules on the same host.
+ *
+ * The channel is a single-producer/single-consumer ring buffer in a POSIX shared memory segment,
+ * named after the output port of the producer. The consumer creates the segment (so the channel is
+ * selected on the consumer side, with the shmFrom option of its input) and the producer attaches to it
+ * as soon as it exists, while keeping its YARP port for the other connections.
+ *
+ * The producer never blocks: when the ring is full the new message is dropped and counted. The consumer
+ * sleeps on a futex, which the producer wakes only when the consumer has announced it is waiting, so a
+ * busy pipeline does not pay any system call. Only Linux is supported; elsewhere open() fails and the
+ * modules keep using their YARP ports.
+ */
+namespace shmChannel
+{
+
+/** Layout of the shared segment: the header is followed by capacity slots of
+ * [ stamp , size , maxSize doubles ]. */
+struct header
+{
+    uint32_t                magic;          ///< Set by the consumer when the segment is ready
+    uint32_t                capacity;       ///< Number of slots
+    uint32_t                maxSize;        ///< Maximum number of doubles per message
+    uint32_t                pad;
+    std::atomic<uint64_t>   head;           ///< Messages written by the producer
+    std::atomic<uint64_t>   tail;           ///< Messages read by the consumer
+    std::atomic<int32_t>    wakeup;         ///< Futex word, incremented by the producer to wake the consumer
+    std::atomic<int32_t>    waiting;        ///< Non-zero while the consumer sleeps on the futex
+    std::atomic<int32_t>    consumerAlive;  ///< Cleared by the consumer when it closes the channel
+    std::atomic<int32_t>    producerAlive;  ///< Set while a producer is attached
+    std::atomic<uint64_t>   dropped;        ///< Messages dropped by the producer because the ring was full
+};
+
+static const uint32_t magicValue = 0x52524c53;
+
+/** Name of the shared memory segment associated to a YARP port name. */
+inline std::string segmentName(const std::string &portName)
+{
+    std::string name = "/iRRLS";
+    for (size_t i = 0 ; i < portName.size() ; ++i)
+        name += (portName[i] == '/') ? '_' : portName[i];
+    return name;
+}
+
+inline size_t slotDoubles(uint32_t maxSize)  { return 2 + maxSize; }
+
+inline size_t segmentSize(uint32_t capacity, uint32_t maxSize)
+{
+    return sizeof(header) + (size_t)capacity * slotDoubles(maxSize) * sizeof(double);
+}
+
+/** True if a consumer has created the channel associated to the given output port. */
+inline bool consumerExists(const std::string &portName)
+{
+#if defined(__linux__)
+    int fd = shm_open(segmentName(portName).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    ::close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(__linux__)
+inline void futexWait(std::atomic<int32_t> *addr, int32_t val, double timeout)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)timeout;
+    ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1e9);
+    syscall(SYS_futex, (int32_t*)addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+inline void futexWake(std::atomic<int32_t> *addr)
+{
+    syscall(SYS_futex, (int32_t*)addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#endif
+
+/** Producer side. */
+class writer
+{
+private:
+    std::string     name;           // Segment name
+    header*         hdr;
+    double*         slots;
+    size_t          mapped;         // Size of the mapping
+    unsigned long   inode;          // Identifies the segment, to detect a consumer restarted after a crash
+    double          lastAttempt;    // Time of the last attempt to attach, or of the last check
+    double          retryPeriod;    // Seconds between two attempts to attach
+
+    static double now()
+    {
+#if defined(__linux__)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#else
+        return 0.0;
+#endif
+    }
+
+    void detach()
+    {
+#if defined(__linux__)
+        if (hdr != 0)
+        {
+            hdr->producerAlive.store(0);
+            munmap(hdr, mapped);
+        }
+#endif
+        hdr = 0;
+        slots = 0;
+    }
+
+    // Attaches to the segment created by the consumer, if any
+    bool attach()
+    {
+#if defined(__linux__)
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header))
+        {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        hdr = (header*)p;
+        mapped = st.st_size;
+        inode = st.st_ino;
+        if (hdr->magic != magicValue || hdr->consumerAlive.load() == 0 ||
+            segmentSize(hdr->capacity, hdr->maxSize) > mapped)
+        {
+            munmap(p, mapped);
+            hdr = 0;
+            return false;
+        }
+        slots = (double*)(hdr + 1);
+        hdr->producerAlive.store(1);
+        printf("Shared memory channel %s attached\n", name.c_str());
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // True if the segment is still the one of the attached consumer
+    bool stillValid()
+    {
+#if defined(__linux__)
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool valid = (fstat(fd, &st) == 0 && (unsigned long)st.st_ino == inode);
+        ::close(fd);
+        return valid;
+#else
+        return false;
+#endif
+    }
+
+public:
+    writer() : hdr(0), slots(0), mapped(0), inode(0), lastAttempt(-1e9), retryPeriod(1.0)
+    {
+    }
+
+    ~writer()
+    {
+        detach();
+    }
+
+    /** @param portName Name of the YARP output port the channel is associated to. */
+    void open(const std::string &portName)
+    {
+        name = segmentName(portName);
+    }
+
+    void close()
+    {
+        detach();
+    }
+
+    /** True if a consumer is attached. */
+    bool isConnected() const { return hdr != 0; }
+
+    /** Writes a message, if a consumer is attached. Never blocks.
+     * @return False if no consumer is attached, the message is too long or the ring is full. */
+    bool write(double stamp, const double *x, size_t n)
+    {
+        if (hdr == 0)
+        {
+            // Polls for a consumer at most once per retryPeriod
+            double t = now();
+            if (name.empty() || t - lastAttempt < retryPeriod)
+                return false;
+            lastAttempt = t;
+            if (!attach())
+                return false;
+        }
+        if (hdr->consumerAlive.load(std::memory_order_relaxed) == 0)
+        {
+            detach();
+            return false;
+        }
+        else
+        {
+            // A consumer which crashed cannot clear consumerAlive: check the segment once per retryPeriod
+            double t = now();
+            if (t - lastAttempt >= retryPeriod)
+            {
+                lastAttempt = t;
+                if (!stillValid())
+                {
+                    detach();
+                    return false;
+                }
+            }
+        }
+        if (n > hdr->maxSize)
+            return false;
+
+        uint64_t head = hdr->head.load(std::memory_order_relaxed);
+        if (head - hdr->tail.load(std::memory_order_acquire) >= hdr->capacity)
+        {
+            hdr->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        double *slot = slots + (head % hdr->capacity) * slotDoubles(hdr->maxSize);
+        slot[0] = stamp;
+        slot[1] = (double)n;
+        memcpy(slot + 2, x, n * sizeof(double));
+        hdr->head.store(head + 1, std::memory_order_release);
+
+#if defined(__linux__)
+        // Full barrier: the store of head must be visible before waiting is checked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (hdr->waiting.load(std::memory_order_relaxed) != 0)
+        {
+            hdr->wakeup.fetch_add(1, std::memory_order_release);
+            futexWake(&hdr->wakeup);
+        }
+#endif
+        return true;
+    }
+};
+
+/** Consumer side. */
+class reader
+{
+private:
+    std::string         name;           // Segment name
+    header*             hdr;
+    double*             slots;
+    size_t              mapped;
+    std::atomic<bool>   interrupted;
+
+public:
+    reader() : hdr(0), slots(0), mapped(0), interrupted(false)
+    {
+    }
+
+    ~reader()
+    {
+        close();
+    }
+
+    /** Creates the channel associated to the output port of the producer.
+     * @param portName Name of the YARP output port of the producer.
+     * @param capacity Number of messages in the ring.
+     * @param maxSize Maximum number of doubles per message.
+     * @return False if the segment cannot be created. */
+    bool open(const std::string &portName, unsigned int capacity, unsigned int maxSize)
+    {
+#if defined(__linux__)
+        name = segmentName(portName);
+        shm_unlink(name.c_str());   // Stale segment of a previous run
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+        {
+            printf("Error: cannot create the shared memory channel %s\n", name.c_str());
+            return false;
+        }
+        mapped = segmentSize(capacity, maxSize);
+        if (ftruncate(fd, mapped) != 0)
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        void *p = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            return false;
+        }
+        hdr = new (p) header;
+        hdr->capacity = capacity;
+        hdr->maxSize = maxSize;
+        hdr->head.store(0);
+        hdr->tail.store(0);
+        hdr->wakeup.store(0);
+        hdr->waiting.store(0);
+        hdr->producerAlive.store(0);
+        hdr->dropped.store(0);
+        hdr->consumerAlive.store(1);
+        slots = (double*)(hdr + 1);
+        // Prefault the ring
+        memset(slots, 0, mapped - sizeof(header));
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic = magicValue;
+        interrupted.store(false);
+        printf("Shared memory channel %s created\n", name.c_str());
+        return true;
+#else
+        printf("Error: shared memory channels are only supported on Linux\n");
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#if defined(__linux__)
+        if (hdr != 0)
+        {
+            hdr->consumerAlive.store(0);
+            munmap(hdr, mapped);
+            shm_unlink(name.c_str());
+        }
+#endif
+        hdr = 0;
+        slots = 0;
+    }
+
+    /** Wakes up a blocking read, which then returns false. */
+    void interrupt()
+    {
+        interrupted.store(true);
+#if defined(__linux__)
+        if (hdr != 0)
+        {
+            hdr->wakeup.fetch_add(1);
+            futexWake(&hdr->wakeup);
+        }
+#endif
+    }
+
+    /** Reads the next message into x (resized to the message length).
+     * @param wait If true, waits for a message.
+     * @return False if no message is available or the reader has been interrupted. */
+    bool read(double &stamp, std::vector<double> &x, bool wait = true)
+    {
+        if (hdr == 0)
+            return false;
+
+        uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+        while (hdr->head.load(std::memory_order_acquire) == tail)
+        {
+            if (!wait || interrupted.load())
+                return false;
+#if defined(__linux__)
+            int32_t w = hdr->wakeup.load(std::memory_order_acquire);
+            hdr->waiting.store(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (hdr->head.load(std::memory_order_acquire) == tail && !interrupted.load())
+                futexWait(&hdr->wakeup, w, 0.1);
+            hdr->waiting.store(0);
+#endif
+        }
+
+        const double *slot = slots + (tail % hdr->capacity) * slotDoubles(hdr->maxSize);
+        stamp = slot[0];
+        size_t n = (size_t)slot[1];
+        x.resize(n);
+        if (n > 0)
+            memcpy(&x[0], slot + 2, n * sizeof(double));
+        hdr->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @return The number of messages dropped by the producer because the ring was full. */
+    uint64_t getDropped() const { return (hdr != 0) ? hdr->dropped.load() : 0; }
+
+    /** @return True if a producer is attached. */
+    bool isConnected() const { return hdr != 0 && hdr->producerAlive.load() != 0; }
+};
+
+}
+
+#endif
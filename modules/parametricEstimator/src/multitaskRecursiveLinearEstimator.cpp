@@ -18,6 +18,7 @@
 #include "multitaskRecursiveLinearEstimator.h"
 #include <cstdio>
 #include <iostream>
+#include <limits>
 
 using namespace std;
 using namespace Eigen;
@@ -72,6 +73,23 @@ const VectorXd & multiTaskRecursiveLinearEstimator::getParameterEstimate() const
 }
 
 
+/*************************************************************************************************/
+void multiTaskRecursiveLinearEstimator::computeInverseDiagonalFactor() const
+{
+    const VectorXd & D = R.vectorD();
+    for(unsigned int i=0; i<n; i++)
+        invD(i) = (D(i) > (std::numeric_limits<double>::min)()) ? 1.0/D(i) : 0.0;
+}
+
+/*************************************************************************************************/
+void multiTaskRecursiveLinearEstimator::computeInverseFactor(MatrixXd &M) const
+{
+    ///< M = L^-1 * P, obtained by permuting the identity and solving in place against the unit lower factor
+    M.setIdentity(n,n);
+    M = R.transpositionsP() * M;
+    R.matrixL().solveInPlace(M);
+}
+
 /*************************************************************************************************/
 void multiTaskRecursiveLinearEstimator::getCovarianceMatrix(MatrixXd &sigma) const
 {
@@ -83,21 +101,68 @@ void multiTaskRecursiveLinearEstimator::getCovarianceMatrix(MatrixXd &sigma) con
         sigma = MatrixXd::Constant(n,n,1e10);
         return;
     }
-    ///< Invert A by solving n times the system: A*x=e_i, 
-    ///< where e_i is a vector with all elements equal to 0, except for the i-th element, which is equal to 1
-    VectorXd e_i(n);
+    ///< A = P^T L D L^T P, hence A^-1 = (L^-1 P)^T D^-1 (L^-1 P)
+    MatrixXd M(n,n);
+    computeInverseFactor(M);
+    computeInverseDiagonalFactor();
+    sigma.noalias() = M.transpose() * invD.asDiagonal() * M;
+
+    // If the covariance is exactly zero it means that there are not enough samples to estimate
+    // the relative parameter, so actually the covariance is infinite
     for(unsigned int i=0; i<n; i++)
-    {
-        e_i.setZero();
-        e_i[i] = 1.0;
-        if(!R.solveInPlace(e_i))
-            printf("Error while computing covariance matrix in loop %d\n", i);
-        sigma.col(i) = e_i;
-
-        // If the covariance is exactly zero it means that there are not enough samples to estimate
-        // the relative parameter, so actually the covariance is infinite
         if(sigma(i,i)==0.0)
             sigma(i,i) = 1e10;
+}
+
+/*************************************************************************************************/
+void multiTaskRecursiveLinearEstimator::getCovarianceDiagonal(VectorXd &sigmaDiag) const
+{
+    assert(sigmaDiag.size()==n);
+    if(sampleCount<(int)n)  
+    {
+        sigmaDiag = VectorXd::Constant(n,1e10);
+        return;
+    }
+    ///< diag(A^-1)_i = sum_k (L^-1 P)_ki^2 / D_k, which avoids the O(n^3) product of the full inverse
+    MatrixXd M(n,n);
+    computeInverseFactor(M);
+    computeInverseDiagonalFactor();
+    sigmaDiag.noalias() = M.cwiseAbs2().transpose() * invD;
+
+    for(unsigned int i=0; i<n; i++)
+        if(sigmaDiag(i)==0.0)
+            sigmaDiag(i) = 1e10;
+}
+
+/*************************************************************************************************/
+double multiTaskRecursiveLinearEstimator::getCovarianceQuadraticForm(const VectorXd &phi) const
+{
+    assert(phi.size()==n);
+    if(sampleCount<(int)n)
+        return 1e10;
+    ///< phi^T A^-1 phi = z^T D^-1 z, with z = L^-1 P phi
+    z.noalias() = R.transpositionsP() * phi;
+    R.matrixL().solveInPlace(z);
+    computeInverseDiagonalFactor();
+    return z.cwiseAbs2().dot(invD);
+}
+
+/*************************************************************************************************/
+void multiTaskRecursiveLinearEstimator::getPredictiveVariance(const MatrixXd &input, VectorXd &variance) const
+{
+    assert(checkDomainSize(input));
+    variance.resize(m);
+    if(sampleCount<(int)n)
+    {
+        variance.setConstant(1e10);
+        return;
+    }
+    computeInverseDiagonalFactor();
+    for(unsigned int out=0; out<m; out++)
+    {
+        z.noalias() = R.transpositionsP() * input.row(out).transpose();
+        R.matrixL().solveInPlace(z);
+        variance(out) = z.cwiseAbs2().dot(invD);
     }
 }
 
@@ -160,4 +225,6 @@ void multiTaskRecursiveLinearEstimator::resizeAllVariables(double lambda)
     x.setZero();
     sigma_oe.resize(m);
     sigma_oe.setOnes();
+    invD.resize(n);
+    z.resize(n);
 }
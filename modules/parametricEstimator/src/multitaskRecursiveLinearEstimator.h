@@ -54,6 +54,8 @@ protected:
     Eigen::VectorXd                 x;      ///< current parameter estimate
     Eigen::VectorXd                 b;      ///< current projected output
     int                     sampleCount;    ///< Number of samples during last training routine
+    mutable Eigen::VectorXd         invD;   ///< Workspace: pseudo-inverse of the diagonal factor D of A
+    mutable Eigen::VectorXd         z;      ///< Workspace: regressor row mapped through the factor of A
 
     /** Checks whether the input is of the desired dimensionality.
      * @param input A sample input.
@@ -74,6 +76,15 @@ protected:
     /** Resize all matrices and vectors based on the current domain and codomain sizes. */
     void resizeAllVariables(double lambda=1.0);
 
+    /** Fill invD with the pseudo-inverse of the diagonal factor of the LDLT decomposition of A.
+     * Null pivots (i.e. parameters not excited by the samples yet) are mapped to 0. */
+    void computeInverseDiagonalFactor() const;
+
+    /** Compute \f$ L^{-1} P \f$, where \f$ A = P^T L D L^T P \f$ is the LDLT decomposition of A,
+     * with a single blocked triangular solve.
+     * @param M Output matrix. */
+    void computeInverseFactor(Eigen::MatrixXd &M) const;
+
 public:
 
     /** Constructor.
@@ -124,6 +135,24 @@ public:
      * @note Remember to call updateParameterEstimate before. */
     void getCovarianceMatrix(Eigen::MatrixXd &sigma) const;
 
+    /** Get the diagonal of the current covariance matrix (i.e. the variances of the parameters),
+     * without forming the full covariance matrix.
+     * @param sigmaDiag Output vector containing the diagonal of the covariance matrix. */
+    void getCovarianceDiagonal(Eigen::VectorXd &sigmaDiag) const;
+
+    /** Compute the quadratic form \f$ \phi^T A^{-1} \phi \f$ with a single triangular solve,
+     * in \f$ O(n^2) \f$ and without allocating memory.
+     * @param phi A regressor row (as a column vector of size n).
+     * @return The value of the quadratic form. */
+    double getCovarianceQuadraticForm(const Eigen::VectorXd &phi) const;
+
+    /** Get the predictive variance of each output for the given input, i.e.
+     * \f$ \phi_i^T A^{-1} \phi_i \f$ for each row \f$ \phi_i \f$ of the regressor.
+     * The variances are expressed in units of the output error variance (see setOutputErrorStandardDeviation).
+     * @param input A sample input.
+     * @param variance Output vector containing the predictive variance of each output. */
+    void getPredictiveVariance(const Eigen::MatrixXd &input, Eigen::VectorXd &variance) const;
+
     /** Get the current state of this estimator under the form of the matrix \f$A\f$ and
      * the vector \f$b\f$, which are defined by this equation:
      * \f[
@@ -23,7 +23,8 @@ using namespace std;
 using namespace Eigen;
 
 multiTaskSVDLinearEstimator::multiTaskSVDLinearEstimator(unsigned int nParam, unsigned int nOutputs, double lambda) 
-    : n(nParam), m(nOutputs), A(n,n), svd_A(n,n), sampleCount(0)
+    : n(nParam), m(nOutputs), A(n,n), svd_A(n,n), eig_A(n), decompType(SELFADJOINT_EIGEN),
+      decompositionValid(false), sampleCount(0)
 { 
     resizeAllVariables(lambda);
 }
@@ -31,7 +32,6 @@ multiTaskSVDLinearEstimator::multiTaskSVDLinearEstimator(unsigned int nParam, un
 /*************************************************************************************************/
 void multiTaskSVDLinearEstimator::feedSample(const MatrixXd &input, const VectorXd &output)
 {
-    bool res;
     /*
     std::cout << "m : " << m << std::endl;
     std::cout << "input total: " << std::endl << input << std::endl;
@@ -54,15 +54,9 @@ void multiTaskSVDLinearEstimator::feedSample(const MatrixXd &input, const Vector
         b += input.row(out)*(output(out)/(sigma_oe(out)*sigma_oe(out)));
     }
     
-    if( sampleCount > 2*n ) {
-        svd_A = svd_A.compute(A, ComputeFullU | ComputeFullV);
-        /*
-        res = svd_A.computeU();
-        assert(res);
-        res = svd_A.computeV();
-        assert(res);
-        */
-    }
+    ///< The decomposition of A is deferred to updateParameterEstimate()
+    decompositionValid = false;
+    
     sampleCount++;
 }
 
@@ -149,6 +143,7 @@ void multiTaskSVDLinearEstimator::setEstimationState(const MatrixXd &Anew, const
     assert(b.size()==n);
     A = Anew;
     b = bNew;
+    decompositionValid = false;
 }
 
 /*************************************************************************************************/
@@ -165,11 +160,50 @@ void multiTaskSVDLinearEstimator::setOutputErrorStandardDeviation(const Eigen::V
     sigma_oe = sigma_oe_input;
 }
 
+/*************************************************************************************************/
+void multiTaskSVDLinearEstimator::setDecompositionType(decompositionType type)
+{
+    if( type != decompType ) {
+        decompType = type;
+        decompositionValid = false;
+    }
+}
+
+/*************************************************************************************************/
+void multiTaskSVDLinearEstimator::updateDecomposition()
+{
+    if( decompositionValid )
+        return;
+    
+    if( decompType == JACOBI_SVD )
+        svd_A.compute(A, ComputeFullU | ComputeFullV);
+    else
+        eig_A.compute(A, ComputeEigenvectors);
+    
+    decompositionValid = true;
+}
+
 /*************************************************************************************************/
 void multiTaskSVDLinearEstimator::updateParameterEstimate()
 {
     if( sampleCount > 3*n ) {
-        x = svd_A.solve(b);
+        updateDecomposition();
+        
+        if( decompType == JACOBI_SVD ) {
+            x = svd_A.solve(b);
+        }
+        else {
+            ///< Minimum-norm solution x = V * pinv(D) * V^T * b, discarding the eigenvalues
+            ///< below the same relative threshold used by JacobiSVD
+            const VectorXd & D = eig_A.eigenvalues();
+            const MatrixXd & V = eig_A.eigenvectors();
+            double threshold = NumTraits<double>::epsilon() * n * D.cwiseAbs().maxCoeff();
+            
+            tmp.noalias() = V.transpose() * b;
+            for(unsigned int i=0; i < n; i++ )
+                tmp(i) = ( D(i) > threshold ) ? tmp(i)/D(i) : 0.0;
+            x.noalias() = V * tmp;
+        }
     }
 }
 
@@ -178,6 +212,9 @@ void multiTaskSVDLinearEstimator::resizeAllVariables(double lambda)
 {
     A = lambda*MatrixXd::Identity(n,n);
     svd_A = Eigen::JacobiSVD<Eigen::MatrixXd>(n,n);
+    eig_A = Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>(n);
+    decompositionValid = false;
+    tmp.resize(n);
     b.resize(n);
     b.setZero();
     x.resize(n);
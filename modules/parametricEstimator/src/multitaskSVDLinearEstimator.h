@@ -21,6 +21,7 @@
 #include <Eigen/Core>                               // import most common Eigen types
 #include <Eigen/Cholesky>
 #include <Eigen/SVD>
+#include <Eigen/Eigenvalues>
 
 /** Class for performing online (i.e. recursive) estimation of parameters
  * according to a linear model of the form:
@@ -44,15 +45,32 @@
  * of the estimation, the Cholesky decomposition of \f$ A_t \f$ is stored, which is a triangular matrix
  * \f$ R_t \in R^{n \times n} \f$ such that \f$ A_t = R_t^T R_t \f$. A rank-1 update rule is used to
  * incrementally update the Cholesky decomposition.
+ *
+ * \f$ A_t \f$ is only decomposed when the parameter estimate is actually requested
+ * (i.e. in updateParameterEstimate()), so feeding samples costs \f$ O(n^2) \f$. Since
+ * \f$ A_t \f$ is symmetric positive semi-definite, a self-adjoint eigendecomposition is
+ * used by default in place of the (much slower) Jacobi SVD; the two give the same
+ * minimum-norm solution.
  */
 class multiTaskSVDLinearEstimator
 {
+public:
+    /** Decomposition used to solve the normal equations. */
+    enum decompositionType {
+        SELFADJOINT_EIGEN,      ///< Self-adjoint eigendecomposition of A (default)
+        JACOBI_SVD              ///< Full Jacobi SVD of A
+    };
+
 protected:
     unsigned int                    n;      ///< The number of parameters
     unsigned int                    m;      ///< The number of outputs
     Eigen::VectorXd          sigma_oe;      ///< Standard deviation of the outputs (default: 1)
     Eigen::MatrixXd                 A;      ///< Inverse covariance matrix (i.e. A).
     Eigen::JacobiSVD<Eigen::MatrixXd> svd_A;///< SVD of A
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig_A;   ///< Eigendecomposition of A
+    decompositionType           decompType; ///< Decomposition used to solve the normal equations
+    bool                    decompositionValid; ///< False if A changed since the last decomposition
+    Eigen::VectorXd                 tmp;    ///< Workspace for the eigenvalue-based solve
     Eigen::VectorXd                 x;      ///< current parameter estimate
     Eigen::VectorXd                 b;      ///< current projected output
     int                     sampleCount;    ///< Number of samples during last training routine
@@ -76,6 +94,9 @@ protected:
     /** Resize all matrices and vectors based on the current domain and codomain sizes. */
     void resizeAllVariables(double lambda);
 
+    /** Decompose A with the selected decomposition, if it changed since the last call. */
+    void updateDecomposition();
+
 public:
 
     /** Constructor.
@@ -105,6 +126,14 @@ public:
     /** Reset the status of the estimator. */
     inline void reset(double lambda=1.0){ resizeAllVariables(lambda); }
 
+    /** Select the decomposition used to solve the normal equations.
+     * @param type The desired decomposition type. */
+    void setDecompositionType(decompositionType type);
+
+    /** Returns the decomposition used to solve the normal equations.
+     * @return The current decomposition type. */
+    inline decompositionType getDecompositionType() const { return decompType; }
+
     /** Get the current estimate of the parameters x.
      * @param xEst Output vector containing the current estimate of the parameters. 
      * @note Remember to call updateParameterEstimate before. */